@@ -23,4 +23,5 @@ APP_ROOT = ROOT_JOIN "app"
 group "Core"
 	include "core/build-core.lua"
 group ""
-   include "app/build-app.lua"
\ No newline at end of file
+   include "app/build-app.lua"
+   include "cooker/build-cooker.lua"
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <filesystem>
+
+#include <jade_engine.hpp>
+
+// converts glTF files into the engine's cooked scene format, the engine picks the cooked file up
+// instead of the glTF when it sits next to it
+int main(int argc, char* argv[]) {
+
+    if (argc < 2 || argc > 3) {
+        std::cout << "usage: Cooker <file or directory> [output directory]" << std::endl;
+        std::cout << "the output defaults to the input directory, so the cooked files end up next to their sources" << std::endl;
+        return 1;
+    }
+
+    const std::filesystem::path source(argv[1]);
+    std::filesystem::path destination = argc == 3 ? std::filesystem::path(argv[2]) :
+        (std::filesystem::is_directory(source) ? source : source.parent_path());
+
+    return jade::cookAssets(source.string().c_str(), destination.string().c_str()) ? 0 : 1;
+}
@@ -15,5 +15,9 @@ extern "C" {
         ENGINE_API_EXPORT void runEngine();
         ENGINE_API_EXPORT void cleanupEngine();
 
+        // cooks every .gltf and .glb in sourcePath (a file or a directory, searched recursively) into
+        // destinationPath, one file per core at a time. false when any file failed
+        ENGINE_API_EXPORT bool cookAssets(const char* sourcePath, const char* destinationPath);
+
     };
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <optional>
+#include <stdint.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "vk_culling.hpp"
+
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct BVHItem {
+	AABB bounds;
+	uint32_t userData;
+};
+
+struct BVHRayHit {
+	uint32_t userData;
+	float distance;
+};
+
+// dynamic bounding volume hierarchy with one item per leaf.
+// the tree is built top down with a binned surface area heuristic, moved items are either
+// re-inserted (moveProxy) or the tree keeps its topology and only the bounds are refitted (setProxyBounds + refit).
+// refitting is cheaper when many items move at once, the tree quality then stays that of the last build
+class SceneBVH {
+  public:
+	static constexpr int32_t kNullNode = -1;
+
+	// replaces the whole tree, returns the proxy of every item in input order
+	std::vector<int32_t> build(std::span<const BVHItem> t_items);
+	void clear();
+
+	// re-inserts the proxy when it left its fattened bounds, returns true if the tree changed
+	bool moveProxy(int32_t t_proxy, const AABB& t_bounds);
+
+	// updates the leaf without touching the topology, call refit afterwards
+	void setProxyBounds(int32_t t_proxy, const AABB& t_bounds);
+	void refit();
+
+	// appends the user data of every item intersecting the frustum. subtrees completely
+	// inside or outside the frustum are accepted or rejected without visiting their leaves
+	void cull(const Frustum& t_frustum, std::vector<uint32_t>& t_out) const;
+
+	// closest item whose bounds are hit by the ray, t_direction does not need to be normalized
+	// but the returned distance is in units of its length
+	std::optional<BVHRayHit> raycast(const glm::vec3& t_origin, const glm::vec3& t_direction, float t_maxDistance) const;
+
+	uint32_t getUserData(int32_t t_proxy) const { return m_nodes[t_proxy].userData; }
+	const AABB& getFatBounds(int32_t t_proxy) const { return m_nodes[t_proxy].bounds; }
+	bool empty() const { return m_root == kNullNode; }
+
+	// fraction of the leaf size added on every side, so small moves dont trigger a re-insert
+	float fatMargin = 0.1f;
+
+  private:
+	struct Node {
+		AABB bounds;
+		int32_t parent;
+		int32_t left;
+		int32_t right;
+		uint32_t userData;
+
+		bool isLeaf() const { return left == kNullNode; }
+	};
+
+	int32_t allocateNode();
+	void freeNode(int32_t t_node);
+	int32_t buildRange(std::vector<BVHItem>& t_items, std::vector<int32_t>& t_leaves, std::vector<uint32_t>& t_order, uint32_t t_begin, uint32_t t_end);
+	void insertLeaf(int32_t t_leaf);
+	void removeLeaf(int32_t t_leaf);
+	void refitUpwards(int32_t t_node);
+	void collectLeaves(int32_t t_node, std::vector<uint32_t>& t_out) const;
+	AABB fatten(const AABB& t_bounds) const;
+
+	std::vector<Node> m_nodes{};
+	int32_t m_root = kNullNode;
+	int32_t m_freeList = kNullNode;
+};
+
+namespace vkBVH {
+	AABB merge(const AABB& t_a, const AABB& t_b);
+	float surfaceArea(const AABB& t_bounds);
+	bool contains(const AABB& t_outer, const AABB& t_inner);
+
+	// bounds of an object space box (origin, extents) after applying t_transform
+	AABB transformBox(const glm::mat4& t_transform, const glm::vec3& t_origin, const glm::vec3& t_extents);
+}
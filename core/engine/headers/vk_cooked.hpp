@@ -0,0 +1,136 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <memory>
+#include <stdint.h>
+
+#include "vk_types.hpp"
+#include "vk_loader.hpp"
+
+// engine native scene file written by the cooker. it holds the final vertex and index arrays, decoded rgba8
+// textures, materials and the flattened node tree of a glTF file. every section is a plain array starting
+// on a 16 byte boundary, the loader maps the file and hands the sections to the upload queue as they are.
+// the layout is little endian and tied to PackedVertex, the version is bumped whenever either changes.
+// version 2: meshes are welded and reordered by vkMesh::optimizeMesh
+// version 3: vertices are stored packed, in the layout of the geometry arena
+namespace cooked {
+
+constexpr uint32_t FileMagic = 0x4E435344; // "DSCN"
+constexpr uint32_t FileVersion = 3;
+constexpr const char* FileExtension = ".jscene";
+constexpr uint64_t SectionAlignment = 16;
+
+struct Section {
+	uint64_t offset{ 0 };
+	uint64_t size{ 0 };
+};
+
+struct Header {
+	uint32_t magic{ FileMagic };
+	uint32_t version{ FileVersion };
+	uint32_t vertexSize{ sizeof(PackedVertex) };
+	uint32_t pad{ 0 };
+
+	Section samplers{};
+	Section images{};
+	Section materials{};
+	Section meshes{};
+	Section surfaces{};
+	Section nodes{};
+	Section vertices{};
+	Section indices{};
+	Section pixels{};
+	Section names{};
+};
+
+// names are ranges of the names section, not null terminated
+struct Name {
+	uint32_t offset{ 0 };
+	uint32_t length{ 0 };
+};
+
+struct Sampler {
+	uint32_t magFilter{ 0 };   // VkFilter
+	uint32_t minFilter{ 0 };   // VkFilter
+	uint32_t mipmapMode{ 0 };  // VkSamplerMipmapMode
+	uint32_t pad{ 0 };
+};
+
+// an image that failed to decode has a zero extent and is replaced by the checkerboard at load time
+struct Image {
+	uint64_t pixelOffset{ 0 }; // into the pixels section, width * height * 4 bytes
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	Name name{};
+};
+
+struct Material {
+	glm::vec4 colorFactors{ 1.f };
+	glm::vec4 metalRoughFactors{ 0.f };
+	int32_t colorImage{ -1 };
+	int32_t colorSampler{ -1 };
+	uint32_t passType{ 0 };    // MaterialPass
+	uint32_t pad{ 0 };
+	Name name{};
+};
+
+// surfaces of a mesh are contiguous. the vertex range of a mesh starts with its GPUVertexHeader,
+// the indices of a surface are relative to the first vertex after it
+struct Mesh {
+	uint32_t firstSurface{ 0 };
+	uint32_t surfaceCount{ 0 };
+	uint32_t firstVertex{ 0 };
+	uint32_t vertexCount{ 0 };
+	uint32_t firstIndex{ 0 };
+	uint32_t indexCount{ 0 };
+	Name name{};
+};
+
+struct Surface {
+	uint32_t startIndex{ 0 };
+	uint32_t count{ 0 };
+	int32_t material{ -1 };
+	Bounds bounds{};
+};
+
+// nodes are stored in topological order, a parent is always before its children
+struct Node {
+	glm::mat4 localMatrix{ 1.f };
+	glm::vec3 translation{ 0.f };
+	glm::quat rotation{ 1.f, 0.f, 0.f, 0.f };
+	glm::vec3 scale{ 1.f };
+	int32_t parent{ -1 };
+	int32_t meshIndex{ -1 };
+	Name name{};
+};
+
+// converts a glTF file into a cooked file, runs without a gpu and can be called from several threads at once
+bool cookGltf(const std::filesystem::path& t_source, const std::filesystem::path& t_destination);
+
+// read only view of a whole file, mapped into memory
+class MappedFile {
+  public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::filesystem::path& t_path);
+	void close();
+
+	const uint8_t* getData() const { return m_data; }
+	size_t getSize() const { return m_size; }
+
+  private:
+	const uint8_t* m_data{ nullptr };
+	size_t m_size{ 0 };
+#ifdef _WIN32
+	void* m_file{ nullptr };
+	void* m_mapping{ nullptr };
+#endif
+};
+
+} // namespace cooked
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadCookedGltf(VulkanEngine* engine, const std::filesystem::path& path);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+// view frustum as 6 inward facing planes (xyz normal, w distance), a point p is inside a plane when dot(n, p) + d >= 0
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// world space bounding spheres in structure of arrays layout, so they can be tested 4 or 8 at a time
+struct SphereBatch {
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	std::vector<uint8_t> visible;
+
+	void clear();
+	void push(const glm::vec4& t_sphere);
+	size_t size() const { return radius.size(); }
+};
+
+namespace vkCull {
+
+	// extracts the normalized frustum planes of a vulkan style clip space (0 <= z <= w), works for reversed depth as well
+	Frustum extractFrustum(const glm::mat4& t_viewProjection);
+
+	// world space bounding sphere of an object space sphere after applying t_transform
+	glm::vec4 transformSphere(const glm::mat4& t_transform, const glm::vec3& t_origin, float t_radius);
+
+	// fills t_batch.visible with 1 for spheres intersecting the frustum and 0 for the rest.
+	// uses AVX (8 spheres per step) or SSE (4 per step) when the compiler targets them, scalar code otherwise.
+	// returns the number of visible spheres
+	size_t testSpheres(const Frustum& t_frustum, SphereBatch& t_batch);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+// 64 bit sort keys for the draw lists. Sorting the keys instead of the render objects
+// keeps the sort cache friendly and lets us use a radix sort instead of a comparator sort.
+//
+// opaque key layout      | pipeline:8 | material:16 | mesh:16 | surface:8 | depth:16 |
+// transparent key layout | inverted depth:16 | pipeline:8 | material:16 | mesh:16 | surface:8 |
+//
+// opaque draws are grouped by state and ordered front to back inside a group,
+// transparent draws are ordered back to front before anything else.
+// keeping the surface above the depth makes copies of the same surface adjacent, so they can be instanced.
+struct DrawKey {
+	uint64_t key;
+	uint32_t index;
+};
+
+namespace vkDraw {
+
+	constexpr uint32_t kPipelineBits = 8;
+	constexpr uint32_t kMaterialBits = 16;
+	constexpr uint32_t kMeshBits = 16;
+	constexpr uint32_t kSurfaceBits = 8;
+	constexpr uint32_t kDepthBits = 16;
+
+	// maps a view space distance to a 16 bit bucket, 0 is the closest bucket
+	uint16_t quantizeDepth(float t_viewDepth, float t_maxDepth);
+
+	uint64_t makeOpaqueKey(uint32_t t_pipelineId, uint32_t t_materialId, uint32_t t_meshId, uint32_t t_surfaceIndex, uint16_t t_depth);
+	uint64_t makeTransparentKey(uint32_t t_pipelineId, uint32_t t_materialId, uint32_t t_meshId, uint32_t t_surfaceIndex, uint16_t t_depth);
+
+	// LSD radix sort on the keys, 8 bits per pass. Passes where every key has the same digit are skipped.
+	// t_scratch is used as the ping pong buffer, keep it alive between frames to avoid reallocations.
+	void radixSort(std::vector<DrawKey>& t_keys, std::vector<DrawKey>& t_scratch);
+}
@@ -3,12 +3,19 @@
 #include <mutex>
 #include <queue>
 #include <functional>
+#include <map>
 
 #include "jade_structs.hpp"
 #include "vk_types.hpp"
 #include "vk_descriptors.hpp"
 #include "vk_loader.hpp"
 #include "vk_camera.hpp"
+#include "vk_draw_keys.hpp"
+#include "vk_culling.hpp"
+#include "vk_threads.hpp"
+#include "vk_material_table.hpp"
+#include "vk_geometry_arena.hpp"
+#include "vk_upload.hpp"
 
 
 struct DeletionQueue
@@ -38,6 +45,11 @@ struct GPUSceneData {
     glm::vec4 sunlightColor;
 };
 
+struct DrawCounters {
+	int drawcalls{0};
+	int triangles{0};
+};
+
 struct FrameData {
 	VkSemaphore swapchainSemaphore{};
 	VkSemaphore renderSemaphore{};
@@ -47,6 +59,36 @@ struct FrameData {
 	VkCommandBuffer mainCommandBuffer{};
 	DescriptorAllocatorGrowable frameDescriptors{};
 	DeletionQueue deletionQueue{};
+
+	// persistently mapped per instance transforms written by prepareGeometry
+	AllocatedBuffer instanceBuffer{};
+	size_t instanceCapacity{0};
+
+	// gpu driven path: object records in, indirect commands and per batch counts out
+	AllocatedBuffer objectBuffer{};
+	size_t objectCapacity{0};
+	AllocatedBuffer drawCommandBuffer{};
+	size_t drawCommandCapacity{0};
+	AllocatedBuffer drawCountBuffer{};
+	size_t drawCountCapacity{0};
+
+	// gpu transform path: instance slots to fill from gpu computed world matrices
+	AllocatedBuffer transformScatterBuffer{};
+	size_t transformScatterCapacity{0};
+
+	// parallel recording: one pool and secondary command buffer per recording job
+	std::vector<VkCommandPool> recordPools{};
+	std::vector<VkCommandBuffer> recordCommandBuffers{};
+
+	// static geometry recorded ahead of time, recorded again when the static set or the viewport changes
+	VkCommandPool staticPool{};
+	VkCommandBuffer staticCommandBuffer{};
+	AllocatedBuffer staticInstanceBuffer{};
+	size_t staticInstanceCapacity{0};
+	uint64_t staticGeneration{0};
+	VkExtent2D staticExtent{};
+	VkDeviceAddress staticMaterialTable{0};
+	DrawCounters staticCounters{};
 };
 
 struct RenderObject {
@@ -58,11 +100,22 @@ struct RenderObject {
 
 	glm::mat4 transform{};
 	VkDeviceAddress vertexBufferAddress{};
+	uint32_t meshId = 0;
+	uint32_t surfaceIndex = 0;
+
+	Bounds bounds{};
+
+	// device address of the world matrix when it is computed on the gpu, 0 when transform is the one drawn
+	VkDeviceAddress transformAddress{};
 };
 
 struct DrawContext {
 	std::vector<RenderObject> OpaqueSurfaces;
 	std::vector<RenderObject> TransparentSurfaces;
+	// scenes with a bvh only emit the nodes intersecting this frustum, null draws everything
+	const Frustum* frustum = nullptr;
+	// scenes with a gpu copy of their hierarchy reference its world matrices instead of providing them
+	bool gpuTransforms = false;
 };
 struct MeshNode : public Node {
 
@@ -71,33 +124,58 @@ struct MeshNode : public Node {
 	virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx) override;
 };
 
+// pushes one render object per surface of the mesh into the opaque or transparent list
+void emitMeshSurfaces(const MeshAsset& mesh, const glm::mat4& transform, DrawContext& ctx, VkDeviceAddress transformAddress = 0);
+
 struct GLTFMetallic_Roughness {
 	MaterialPipeline opaquePipeline{};
 	MaterialPipeline transparentPipeline{};
+	MaterialPipeline bindlessOpaquePipeline{};
+	MaterialPipeline bindlessTransparentPipeline{};
 
 	VkDescriptorSetLayout materialLayout{};
 
-	struct MaterialConstants {
-		glm::vec4 colorFactors{};
-		glm::vec4 metalRoughFactors{};
-		//padding, we need it anyway for uniform buffers
-		glm::vec4 extra[14];
-	};
-
 	struct MaterialResources {
 		AllocatedImage colorImage{};
 		VkSampler colorSampler{};
 		AllocatedImage metalRoughImage{};
 		VkSampler metalRoughSampler{};
-		VkBuffer dataBuffer{};
-		uint32_t dataBufferOffset=0;
+		glm::vec4 colorFactors{ 1.f };
+		glm::vec4 metalRoughFactors{ 1.f, 0.5f, 0.f, 0.f };
+		// slot in materialTable, allocated by the owner of the material
+		uint32_t materialIndex = 0;
 	};
 
 	DescriptorWriter writer{};
 
+	uint32_t nextMaterialId{0};
+
+	// parameters of every material, read by both the descriptor set and the bindless path
+	MaterialTable materialTable{};
+
+	// bindless mode: every texture sits in one update after bind array indexed through the material table,
+	// so set 1 is bound once per pipeline
+	static constexpr uint32_t maxBindlessTextures = 4096;
+	VkDescriptorSetLayout bindlessLayout{};
+	VkDescriptorPool bindlessPool{};
+	VkDescriptorSet bindlessSet{};
+	std::map<std::pair<VkImageView, VkSampler>, uint32_t> bindlessTextureSlots{};
+	// key and number of materials using every slot, slots nobody uses any more are handed out again
+	std::vector<std::pair<VkImageView, VkSampler>> bindlessSlotKeys{};
+	std::vector<uint32_t> bindlessSlotUsers{};
+	std::vector<uint32_t> freeTextureSlots{};
+	uint32_t nextTextureSlot{0};
+
 	void buildPipelines(VulkanEngine* engine);
+	void initBindless(VulkanEngine* engine);
 	void clearResources(VkDevice device);
 
+	uint32_t registerTexture(VkDevice device, VkImageView image, VkSampler sampler);
+	void unregisterTexture(uint32_t slot);
+	// gives back the table range of a file and the texture slots its materials registered
+	void releaseMaterials(uint32_t first, uint32_t count);
+	MaterialPipeline* getBindlessPipeline(MaterialPass pass);
+
 	MaterialInstance writeMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator);
 };
 
@@ -110,6 +188,67 @@ struct ComputePushConstants {
 	glm::vec4 data4;
 };
 
+// object record consumed by cull.comp
+struct GPUObjectData {
+	glm::vec4 sphere; // world space center, w for radius
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t batchIndex;
+	uint32_t commandOffset;
+};
+
+struct GPUCullPushConstants {
+	glm::vec4 frustumPlanes[6];
+	VkDeviceAddress objectBuffer;
+	VkDeviceAddress drawCommandBuffer;
+	VkDeviceAddress drawCountBuffer;
+	uint32_t objectCount;
+};
+
+// local transform of a hierarchy node as read by transforms.comp
+struct GPUTransformNode {
+	glm::vec4 translation;
+	glm::vec4 rotation; // quaternion xyzw
+	glm::vec4 scale;
+	int32_t parent;
+	uint32_t pad[3];
+};
+
+// shared by transforms.comp and transform_scatter.comp, the scatter pass ignores topMatrix
+struct GPUTransformPushConstants {
+	glm::mat4 topMatrix;
+	VkDeviceAddress inputBuffer;
+	VkDeviceAddress outputBuffer;
+	uint32_t first;
+	uint32_t count;
+};
+
+// instance slot that takes its matrix from a gpu computed world matrix
+struct GPUTransformScatter {
+	VkDeviceAddress source;
+	uint32_t instanceIndex;
+	uint32_t pad;
+};
+
+// one recorded draw call, the draw lists are flattened into these before recording so they can be split between threads
+struct DrawItem {
+	MaterialInstance* material;
+	VkBuffer indexBuffer;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t instanceCount;
+	uint32_t firstInstance;
+	int32_t indirectBatch; // index into gpuDrivenBatches for an indirect count draw, -1 for a direct draw
+};
+
+// run of sorted opaque draws sharing material and mesh buffers, drawn with one indirect count call
+struct GPUDrivenBatch {
+	MaterialInstance* material;
+	VkBuffer indexBuffer;
+	uint32_t commandOffset;
+	uint32_t maxDrawCount;
+};
+
 struct ComputeEffect {
     const char* name;
 
@@ -122,6 +261,7 @@ struct EngineStats {
     float frametime;
     int triangle_count;
     int drawcall_count;
+    int culled_count;
     float scene_update_time;
     float mesh_draw_time;
 };
@@ -163,6 +303,14 @@ public:
 
 	VkQueue graphicsQueue{};
 	uint32_t graphicsQueueFamily{};
+	VkQueue transferQueue{};
+	uint32_t transferQueueFamily{};
+
+	// mesh and texture copies, submitted without blocking the cpu
+	UploadQueue uploadQueue{};
+	// the main device local heap is host visible (resizable bar, integrated gpus, software drivers), geometry
+	// is written in place instead of through the upload queue
+	bool hostVisibleDeviceMemory{ false };
 
 	DeletionQueue mainDeletionQueue{};
 
@@ -192,7 +340,10 @@ public:
 	VkPipelineLayout meshPipelineLayout{};
 	VkPipeline meshPipeline{};
 	
-	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	GPUMeshBuffers uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices);
+	// already packed vertices, starting with the VertexHeaderSlots of the header
+	GPUMeshBuffers uploadMesh(std::span<const uint32_t> indices, std::span<const PackedVertex> packedVertices);
+	void releaseMesh(const GPUMeshBuffers& mesh);
 
 	std::vector<std::shared_ptr<MeshAsset>> testMeshes{};
 
@@ -204,6 +355,12 @@ public:
 	GPUSceneData sceneData{};
 	VkDescriptorSetLayout gpuSceneDataDescriptorLayout{};
 
+	// persistently mapped ring holding one GPUSceneData slot per frame in flight,
+	// bound through a dynamic uniform buffer descriptor that is written once at startup
+	AllocatedBuffer sceneDataRing{};
+	size_t sceneDataStride{};
+	VkDescriptorSet sceneDataDescriptors{};
+
 	AllocatedImage whiteImage{};
 	AllocatedImage blackImage{};
 	AllocatedImage greyImage{};
@@ -219,6 +376,57 @@ public:
 
 
 	DrawContext mainDrawContext{};
+	// sort keys of the draw lists, kept between frames to avoid reallocating
+	std::vector<DrawKey> opaqueDrawKeys{};
+	std::vector<DrawKey> transparentDrawKeys{};
+	std::vector<DrawKey> drawKeyScratch{};
+	uint32_t nextMeshId{0};
+
+	// vertex and index storage of every mesh
+	GeometryArena geometryArena{};
+	// glTF meshes are welded and reordered for the vertex cache, overdraw and fetch when they are loaded.
+	// only read while loading, set it before init. cooked scenes are always optimized by the cooker
+	bool optimizeMeshes{true};
+
+	// cpu frustum culling of the draw lists, runs at the end of updateScene
+	bool useFrustumCulling{true};
+	SphereBatch cullSpheres{};
+	Frustum cameraFrustum{};
+
+	// name of the node under the cursor on the last left click, picked through the scene bvhs
+	std::string pickedNodeName{};
+
+	// gpu driven rendering, opaque draws are culled by a compute pass and drawn with indirect count
+	bool useGpuDrivenRendering{false};
+	VkPipeline cullPipeline{};
+	VkPipelineLayout cullPipelineLayout{};
+	std::vector<GPUDrivenBatch> gpuDrivenBatches{};
+
+	// gpu transform path, world matrices of the loaded scenes are propagated level by level in compute
+	// and copied into the instance buffer, instead of being uploaded from the cpu every frame
+	bool useGpuTransforms{false};
+	VkPipeline transformLevelPipeline{};
+	VkPipeline transformScatterPipeline{};
+	VkPipelineLayout transformPipelineLayout{};
+	std::vector<GPUTransformScatter> transformScatters{};
+
+	// draw recording split across worker threads into secondary command buffers
+	bool useParallelRecording{false};
+	ThreadPool workerThreads{};
+	std::vector<DrawItem> drawItems{};
+
+	// materials read from the global bindless set instead of binding one descriptor set per material
+	bool useBindlessMaterials{false};
+
+	// scenes marked static are drawn from per frame pre-recorded command buffers instead of the draw lists.
+	// a bundle always draws the whole static set, it trades culling for recording cost and is only used
+	// while frustum culling is off
+	bool useStaticBundles{false};
+	DrawContext staticDrawContext{};
+	// scene id and hierarchy version of every static scene the bundles were recorded from
+	std::vector<std::pair<uint64_t, uint64_t>> staticSignature{};
+	uint64_t staticGeneration{0};
+	uint64_t nextSceneId{0};
     std::unordered_map<std::string, std::shared_ptr<Node>> loadedNodes{};
 
 	std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> loadedScenes{};
@@ -249,7 +457,10 @@ public:
 	AllocatedImage createImage(void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
 	void destroyImage(const AllocatedImage& img);
 	void updateScene();
-	AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+	// dynamic buffers use VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE with HOST_ACCESS_SEQUENTIAL_WRITE so they land in
+	// host visible vram when there is some
+	AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VmaAllocationCreateFlags allocFlags = 0);
+	bool isHostVisibleDeviceLocal(const AllocatedBuffer& buffer) const;
 	void destroyBuffer(const AllocatedBuffer& buffer);
 
 private:
@@ -263,9 +474,25 @@ private:
 	void initDescriptors();
 	void initPipelines();
 	void initBackgroundPipelines();
+	void initCullPipeline();
+	void initTransformPipelines();
 	void initImgui();
 	void drawImgui(VkCommandBuffer cmd, VkImageView targetImageView);
+	void cullDrawContext();
+	void pickScene(int x, int y);
+	void prepareGeometry(VkCommandBuffer cmd);
+	void cullGeometry(VkCommandBuffer cmd);
+	void propagateTransforms(VkCommandBuffer cmd);
 	void drawGeometry(VkCommandBuffer cmd);
+	void appendInstancedDraws(std::vector<DrawItem>& items, const std::vector<DrawKey>& keys, const std::vector<RenderObject>& surfaces, uint32_t instanceBase);
+	void recordDraws(VkCommandBuffer cmd, const DrawItem* items, size_t count, VkDeviceAddress instanceBufferAddress, DrawCounters& counters);
+	void recordStaticBundle(FrameData& frame);
+	void updateStaticSet();
+	bool drawsStaticBundles() const { return useStaticBundles && !useFrustumCulling; }
+	// the draws are recorded into secondary command buffers, the render pass can not contain inline draws then
+	bool recordsSecondaries() const { return useParallelRecording || drawsStaticBundles(); }
+	void reserveFrameBuffer(AllocatedBuffer& buffer, size_t& capacity, size_t count, size_t elementSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VmaAllocationCreateFlags allocFlags = 0);
+	VkDeviceAddress getBufferAddress(const AllocatedBuffer& buffer);
 
 
 	void initMeshPipeline();
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "vk_types.hpp"
+#include "vk_range_allocator.hpp"
+
+class VulkanEngine;
+
+// every mesh lives in a range of a few large vertex and index buffers instead of owning two buffers.
+// draws of meshes in the same block share the index buffer, so it is rarely rebound and indirect
+// draws can be merged across meshes. a new block is opened when none of the existing ones has room
+class GeometryArena {
+  public:
+	void init(VulkanEngine* t_engine, uint32_t t_blockVertices, uint32_t t_blockIndices);
+	void destroy();
+
+	// fills the buffers, offsets and ranges of t_mesh, counted in PackedVertex slots including the header
+	void allocate(uint32_t t_vertexCount, uint32_t t_indexCount, GPUMeshBuffers& t_mesh);
+	void release(const GPUMeshBuffers& t_mesh);
+	// copies straight into the block when it lives in host visible vram, false when it has to be uploaded
+	bool write(const GPUMeshBuffers& t_mesh, const void* t_vertices, const void* t_indices);
+
+	uint32_t getBlockCount() const { return static_cast<uint32_t>(m_blocks.size()); }
+
+  private:
+	struct Block {
+		AllocatedBuffer vertexBuffer{};
+		AllocatedBuffer indexBuffer{};
+		VkDeviceAddress vertexAddress{ 0 };
+		bool hostVisible{ false };
+		RangeAllocator vertices{};
+		RangeAllocator indices{};
+	};
+
+	void addBlock(uint32_t t_vertexCount, uint32_t t_indexCount);
+
+	VulkanEngine* m_engine{ nullptr };
+	uint32_t m_blockVertices{ 0 };
+	uint32_t m_blockIndices{ 0 };
+	std::vector<Block> m_blocks{};
+};
@@ -6,7 +6,8 @@
 namespace vkInit{
     VkCommandPoolCreateInfo command_pool_create_info(uint32_t queueFamilyIndex,VkCommandPoolCreateFlags flags = 0);
 
-    VkCommandBufferAllocateInfo command_buffer_allocate_info(VkCommandPool pool, uint32_t count = 1);
+    VkCommandBufferAllocateInfo command_buffer_allocate_info(VkCommandPool pool, uint32_t count = 1,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
     VkFenceCreateInfo fence_create_info(VkFenceCreateFlags flags = 0);
 
@@ -8,13 +8,23 @@
 
 #include "vk_types.hpp"
 #include "vk_transform.hpp"
+#include "vk_bvh.hpp"
+#include "vk_upload.hpp"
 struct GLTFMaterial {
 	MaterialInstance data;
 };
 
+// object space bounds of a surface, an axis aligned box around origin plus its bounding sphere
+struct Bounds {
+    glm::vec3 origin;
+    float sphereRadius;
+    glm::vec3 extents;
+};
+
 struct GeoSurface {
     uint32_t startIndex;
     uint32_t count;
+    Bounds bounds;
     std::shared_ptr<GLTFMaterial> material;
 };
 
@@ -26,6 +36,46 @@ struct MeshAsset {
 };
 //forward declaration
 class VulkanEngine;
+class ThreadPool;
+
+// node tree of a file flattened into parallel arrays in topological order, a parent is always stored before its children.
+// world transforms are computed with one linear pass and drawing walks the arrays, no pointers or virtual calls involved.
+// only dirty nodes and their descendants are recomputed, a hierarchy where nothing moved costs nothing
+struct SceneHierarchy {
+    std::vector<int32_t> parents;       // -1 for the top nodes
+    std::vector<Transformation> localTransforms;
+    std::vector<glm::mat4> worldTransforms;
+    std::vector<int32_t> meshIndices;   // index into LoadedGLTF::meshList, -1 for nodes without a mesh
+    std::vector<std::string> names;
+
+    // flat indices of the nodes that have a mesh
+    std::vector<uint32_t> meshNodes;
+
+    std::vector<uint8_t> dirty;
+    bool hasDirtyNodes = false;
+
+    // depth of every node and the first node of every depth level, levels are contiguous in topological order
+    std::vector<uint32_t> depths;
+    std::vector<uint32_t> levelOffsets;
+
+    // bumped on every change to the nodes, lets copies of the hierarchy tell whether they are stale
+    uint64_t version = 0;
+
+    // scratch for the batched matrix composition of the dirty nodes
+    TransformationBatch localBatch;
+    std::vector<glm::mat4> localMatrices;
+
+    size_t size() const { return parents.size(); }
+    uint32_t addNode(int32_t parent, const Transformation& localTransform, int32_t meshIndex, std::string name);
+
+    // marks the node dirty, edits through the returned reference are picked up by the next refresh
+    Transformation& editLocalTransform(uint32_t index);
+
+    // recomputes the world matrices of the dirty subtrees, fills changed with the touched nodes in ascending order
+    void refreshTransforms(std::vector<uint32_t>& changed);
+};
+
+Bounds computeBounds(std::span<const Vertex> vertices);
 
 std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadMesh(VulkanEngine* engine, std::filesystem::path path);
 
@@ -44,20 +94,97 @@ struct LoadedGLTF : public IRenderable {
 
     DescriptorAllocatorGrowable descriptorPool;
 
-    AllocatedBuffer materialDataBuffer;
+    // the copies of the meshes and textures of this file, finished once the upload queue reached it
+    UploadTicket uploadTicket{};
+
+    // range of the shared material table owned by this file
+    uint32_t firstMaterialIndex = 0;
+    uint32_t materialCount = 0;
 
     VulkanEngine* creator;
+    // unique for the lifetime of the engine, unlike the address of the scene
+    uint64_t sceneId = 0;
+
+    // static scenes may be drawn from pre-recorded command buffers, edits through the hierarchy still get picked up
+    bool isStatic = false;
+
+    // meshes in glTF order, referenced by SceneHierarchy::meshIndices
+    std::vector<std::shared_ptr<MeshAsset>> meshList;
+
+    // flattened copy of the node tree used for transforms and drawing, it owns the transforms after loading.
+    // the Node objects are kept for lookups by name
+    SceneHierarchy hierarchy;
+
+    // bounds of the mesh nodes in the space of the file, before the top matrix is applied.
+    // the user data of a leaf is the flat node index, proxies are parallel to hierarchy.meshNodes
+    SceneBVH bvh;
+    std::vector<int32_t> meshNodeProxies;
+
+    // nodes touched by the last transform refresh
+    std::vector<uint32_t> changedNodes;
+
+    // top matrix of the last Draw, the cached draw matrices are built with it
+    glm::mat4 drawTopMatrix { 1.f };
+
+    // gpu copy of the hierarchy, created by the engine the first time the gpu transform path runs.
+    // the node buffer holds the local TRS and parent of every node, one copy per frame in flight,
+    // the world buffer holds drawTopMatrix * world matrix of every node and is written by a compute pass
+    AllocatedBuffer gpuNodeBuffer {};
+    AllocatedBuffer gpuWorldBuffer {};
+    VkDeviceAddress gpuWorldAddress = 0;
+    // nodes changed since each copy of the node buffer was written, a copy flagged for rewrite is written whole.
+    // the world matrices are current above gpuDirtyLevel, it equals the level count when nothing is stale
+    std::vector<std::vector<uint32_t>> gpuPendingNodes;
+    std::vector<uint8_t> gpuNodeRewrite;
+    uint32_t gpuDirtyLevel = 0;
+    glm::mat4 gpuWorldTopMatrix { 1.f };
 
     ~LoadedGLTF() { clearAll(); };
 
     virtual void Draw(const glm::mat4& topMatrix, DrawContext& ctx);
 
+    // builds the bvh from scratch, call after the world transforms are set up
+    void buildBVH();
+    // recomputes the world transforms of the nodes edited through hierarchy.editLocalTransform and re-inserts
+    // them in the bvh if they left their bounds, or refits it when many moved. the cached draw matrices are only
+    // updated when the world matrices are not written on the gpu, the changed nodes are queued for upload then
+    void refreshTransforms(bool gpuTransforms = false);
+    // closest mesh node whose bounds are hit by the ray, given in the space of the file
+    std::optional<BVHRayHit> raycast(const glm::vec3& origin, const glm::vec3& direction) const;
+
 private:
 
+    AABB meshNodeBounds(uint32_t nodeIndex) const;
+    void drawNode(uint32_t nodeIndex, DrawContext& ctx) const;
     void clearAll();
+
+    std::vector<uint32_t> visibleNodes;
+
+    // topMatrix * world matrix of every mesh node, reused until the top matrix or the node changes
+    std::vector<glm::mat4> drawTransforms;
+    bool drawTransformsValid = false;
 };
 
+// loads the cooked copy of the file instead when there is an up to date one next to it
 std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::string_view filePath);
+// TRS of a node matrix for the flat hierarchy. a matrix that does not decompose keeps its translation and axis
+// lengths with no rotation, the dropped parts are logged
+Transformation decomposeNodeMatrix(const glm::mat4& matrix, std::string_view nodeName);
+// parses a .gltf or .glb with its buffers loaded, shared by the loader and the cooker
+std::optional<fastgltf::Asset> parseGltf(const std::filesystem::path& path);
+// appends the vertices and indices of a primitive, the indices are offset by the vertices already in the array.
+// large primitives are assembled on the workers when given, colorsFromNormals writes the normal as the color
+void loadPrimitive(fastgltf::Asset& gltf, fastgltf::Primitive& p, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices,
+    ThreadPool* workers = nullptr, bool colorsFromNormals = false);
 VkFilter extractFilter(fastgltf::Filter filter);
 VkSamplerMipmapMode extractMipmapMode(fastgltf::Filter filter);
-std::optional<AllocatedImage> loadImage(VulkanEngine* engine, fastgltf::Asset& asset, fastgltf::Image& image);
\ No newline at end of file
+
+// rgba8 pixels from stb_image, null when the decode failed. decoding touches no engine state so it can
+// run on the worker threads
+struct DecodedImage {
+    unsigned char* pixels{ nullptr };
+    VkExtent3D extent{};
+};
+DecodedImage decodeImage(fastgltf::Asset& asset, fastgltf::Image& image);
+// creates and uploads the image, frees the pixels
+std::optional<AllocatedImage> uploadDecodedImage(VulkanEngine* engine, DecodedImage& decoded);
\ No newline at end of file
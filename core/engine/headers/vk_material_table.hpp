@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "vk_types.hpp"
+#include "vk_range_allocator.hpp"
+
+class VulkanEngine;
+
+// packed std430 table of GPUMaterialData shared by every loaded glTF.
+// each file sub-allocates a contiguous range, the shaders index the table with the material index of the draw
+// through its buffer device address, so growing it never touches a descriptor set.
+// the buffer holds one copy of the table per frame in flight, a write only reaches the copy of a frame once
+// that frame begins, so frames still in flight never see an entry change under them
+class MaterialTable {
+  public:
+	void init(VulkanEngine* t_engine, uint32_t t_initialCapacity);
+	void destroy();
+
+	// first index of t_count consecutive entries, grows the buffer when no free range fits
+	uint32_t allocate(uint32_t t_count);
+	void release(uint32_t t_first, uint32_t t_count);
+
+	void write(uint32_t t_index, const GPUMaterialData& t_data);
+	const GPUMaterialData& getEntry(uint32_t t_index) const { return m_entries[t_index]; }
+
+	// uploads the writes that copy t_frameIndex has not seen yet, call once the fence of that frame signaled
+	void beginFrame(uint32_t t_frameIndex);
+
+	// copy of the frame that began last. changes when the table grows, draws recorded ahead of time have to be recorded again
+	VkDeviceAddress getAddress() const { return m_address + m_frameIndex * getCapacity() * sizeof(GPUMaterialData); }
+	uint32_t getCapacity() const { return m_ranges.getCapacity(); }
+
+  private:
+	void grow(uint32_t t_minCapacity);
+
+	VulkanEngine* m_engine{ nullptr };
+	AllocatedBuffer m_buffer{};
+	VkDeviceAddress m_address{ 0 };
+	uint32_t m_frameIndex{ 0 };
+	// cpu copy of the table, uploaded into the new buffer when it grows
+	std::vector<GPUMaterialData> m_entries{};
+	// entries written since every frame copy was last brought up to date
+	std::vector<std::vector<uint32_t>> m_pending{};
+	RangeAllocator m_ranges{};
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+#include <vector>
+
+#include <fastgltf/types.hpp>
+
+#include "vk_types.hpp"
+
+// index range of one surface inside the index array of a mesh, with the topology of the primitive it came from
+struct IndexRange {
+    uint32_t start = 0;
+    uint32_t count = 0;
+    fastgltf::PrimitiveType topology = fastgltf::PrimitiveType::Triangles;
+};
+
+// import time processing of triangle lists, so the vertex fetch through the buffer reference in mesh.vert
+// and the post transform cache see good locality whatever order the exporter wrote
+namespace vkMesh {
+
+    // vertices used by the cache simulation and the cache optimizer
+    constexpr uint32_t CacheSize = 16;
+
+    // merges bitwise identical vertices and rewrites the indices, returns the new vertex count
+    size_t weldVertices(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices);
+
+    // reorders the triangles for the post transform vertex cache (tipsify), indices are below t_vertexCount
+    void optimizeVertexCache(uint32_t* t_indices, size_t t_indexCount, size_t t_vertexCount);
+
+    // reorders clusters of cache optimized triangles so the ones facing away from the mesh center are drawn first.
+    // clusters are cut where their acmr reaches t_threshold times the acmr of the cache optimized order,
+    // so the vertex cache hit rate drops by at most that factor
+    void optimizeOverdraw(uint32_t* t_indices, size_t t_indexCount, const glm::vec3* t_positions, size_t t_vertexCount, float t_threshold = 1.05f);
+
+    // renumbers the vertices in the order the indices first use them and drops unused ones, returns the new vertex count
+    size_t optimizeVertexFetch(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices);
+
+    // all of the above. every range is reordered on its own so surfaces keep their index ranges, the
+    // vertices are shared by the whole mesh. ranges that are not triangle lists are only renumbered with the vertices
+    void optimizeMesh(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices, std::span<const IndexRange> t_ranges);
+}
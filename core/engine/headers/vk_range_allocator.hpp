@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <stdint.h>
+
+// offset allocator over [0, capacity): first fit on a free list sorted by offset, neighbouring free ranges
+// are merged on release. used for sub-allocating shared buffers in element units
+class RangeAllocator {
+  public:
+	void init(uint32_t t_capacity);
+	void clear();
+
+	// offset of t_count consecutive elements, empty when no free range is large enough
+	std::optional<uint32_t> allocate(uint32_t t_count);
+	void release(uint32_t t_first, uint32_t t_count);
+
+	// adds [capacity, t_capacity) as free space
+	void grow(uint32_t t_capacity);
+
+	uint32_t getCapacity() const { return m_capacity; }
+	// free elements at the end of the range, an allocation that does not fit needs capacity grown by the rest
+	uint32_t getFreeTail() const;
+
+  private:
+	struct Range {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	uint32_t m_capacity{ 0 };
+	std::vector<Range> m_freeRanges{};
+};
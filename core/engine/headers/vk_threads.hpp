@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdint.h>
+
+// fixed set of worker threads pulling tasks from a shared queue
+class ThreadPool {
+  public:
+	~ThreadPool() { stop(); }
+
+	void start(uint32_t t_threadCount);
+	// finishes the queued tasks and joins the workers
+	void stop();
+
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+	// queues a task, it runs on any worker
+	void submit(std::function<void()> t_task);
+
+	// runs t_job for every index in [0, t_count) on the workers and the calling thread,
+	// returns once all of them finished
+	void parallelFor(uint32_t t_count, const std::function<void(uint32_t)>& t_job);
+
+  private:
+	void workerLoop();
+
+	std::vector<std::thread> m_threads{};
+	std::deque<std::function<void()>> m_tasks{};
+	std::mutex m_mutex{};
+	std::condition_variable m_wakeUp{};
+	bool m_stopping{ false };
+};
@@ -56,12 +56,43 @@ struct Vertex {
 
 };
 
+// vertex layout of the geometry arena, 16 bytes. the position is unorm16 relative to the bounds of the mesh,
+// the normal octahedral snorm8, the uv unorm16 relative to the uv range of the mesh and the color rgba8.
+// decoded by unpackVertex in vertex_structures.glsl
+struct PackedVertex {
+    uint16_t position[3];
+    int8_t normal[2];
+    uint16_t uv[2];
+    uint8_t color[4];
+};
+
+// dequantization ranges of a mesh, stored in the arena right before its packed vertices
+struct GPUVertexHeader {
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    // xy offset, zw scale
+    glm::vec4 uvOffsetScale;
+};
+
+// arena slots taken by the header in front of the vertices of every mesh
+constexpr uint32_t VertexHeaderSlots = sizeof(GPUVertexHeader) / sizeof(PackedVertex);
+static_assert(sizeof(PackedVertex) == 16 && sizeof(GPUVertexHeader) % sizeof(PackedVertex) == 0, "the header fills whole vertex slots");
+
 // holds the resources needed for a mesh
+// range of the geometry arena holding a mesh, the buffers are shared with the other meshes of the block
 struct GPUMeshBuffers {
 
-    AllocatedBuffer indexBuffer;
-    AllocatedBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    VkBuffer vertexBuffer;
+    // address of the vertex header of the mesh, the indices are relative to the first vertex after it
     VkDeviceAddress vertexBufferAddress;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t arenaBlock;
+    // identifier used to group draws of the same mesh when sorting
+    uint32_t meshId;
 };
 
 // push constants for our mesh object draws
@@ -69,6 +100,30 @@ struct GPUDrawPushConstants {
     glm::mat4 worldMatrix;
     VkDeviceAddress vertexBuffer;
 };
+
+// per draw data of the material pipelines, indexed with gl_InstanceIndex (which includes firstInstance)
+struct GPUInstanceData {
+    glm::mat4 worldMatrix;
+    VkDeviceAddress vertexBuffer;
+    uint32_t materialIndex;
+    uint32_t pad;
+};
+
+// entry of the shared material table, indexed with the material index of the draw
+struct GPUMaterialData {
+    glm::vec4 colorFactors;
+    glm::vec4 metalRoughFactors;
+    uint32_t colorTexture;
+    uint32_t metalRoughTexture;
+    uint32_t pad[2];
+};
+
+// push constants of the material pipelines, everything per draw lives in the instance buffer
+// and the material parameters in the shared material table
+struct GPUMeshPushConstants {
+    VkDeviceAddress instanceBuffer;
+    VkDeviceAddress materialBuffer;
+};
 enum class MaterialPass :uint8_t {
     MainColor,
     Transparent,
@@ -77,12 +132,16 @@ enum class MaterialPass :uint8_t {
 struct MaterialPipeline {
 	VkPipeline pipeline;
 	VkPipelineLayout layout;
+	uint32_t sortId;
 };
 
 struct MaterialInstance {
     MaterialPipeline* pipeline;
     VkDescriptorSet materialSet;
     MaterialPass passType;
+    uint32_t sortId;
+    // entry in the shared material table
+    uint32_t materialIndex;
 };
 
 struct DrawContext;
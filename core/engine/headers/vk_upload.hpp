@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <optional>
+#include <stdint.h>
+
+#include "vk_types.hpp"
+
+class VulkanEngine;
+
+// handed back for every upload, the data is on the gpu once the timeline semaphore reached the value
+struct UploadTicket {
+	uint64_t value{ 0 };
+};
+
+// copies into gpu only resources on a transfer capable queue without blocking the cpu.
+// uploads are gathered into an open batch, flush() records all of its copies and layout transitions into
+// one command buffer (copies into the same buffer merged, barriers in two calls), submits it and signals
+// the timeline semaphore with the batch ticket. when the transfer queue belongs to another family the ownership of every resource is
+// released here and acquired again on the graphics queue by recordAcquires(), otherwise it records
+// barriers making the copies visible to the graphics reads.
+// the data is staged in one persistently mapped ring, the space of a batch is reclaimed once its ticket
+// completed. payloads larger than a quarter of the ring are copied in chunks, image bands follow the
+// transfer granularity of the family
+class UploadQueue {
+  public:
+	void init(VulkanEngine* t_engine, VkQueue t_queue, uint32_t t_queueFamily, uint32_t t_graphicsFamily, VkDeviceSize t_stagingSize);
+	void destroy();
+
+	UploadTicket uploadBuffer(VkBuffer t_dst, VkDeviceSize t_dstOffset, const void* t_data, size_t t_size);
+	// copies mip 0 and leaves the image in shader read only layout
+	UploadTicket uploadImage(const AllocatedImage& t_image, const void* t_data, size_t t_size);
+
+	// submits the open batch, returns its ticket (the last submitted one when nothing was recorded)
+	UploadTicket flush();
+
+	bool isComplete(UploadTicket t_ticket) const;
+	// blocks the cpu, for teardown and for resources that are about to be released
+	void wait(UploadTicket t_ticket) const;
+
+	// records the acquire barriers of the batches submitted since the last call (plain visibility barriers when the
+	// families match) and returns the value the graphics submit has to wait on, 0 when nothing was submitted since
+	uint64_t recordAcquires(VkCommandBuffer t_cmd);
+
+	VkSemaphore getSemaphore() const { return m_semaphore; }
+
+  private:
+	struct BufferCopy {
+		VkBuffer dst{};
+		VkBufferCopy region{};
+	};
+	struct ImageCopy {
+		// the ring, or a dedicated buffer for an image that has to be copied whole and does not fit
+		VkBuffer src{};
+		VkImage dst{};
+		VkBufferImageCopy region{};
+	};
+
+	struct Batch {
+		VkCommandBuffer cmd{};
+		uint64_t value{ 0 };
+		// staging ring bytes used by the batch (wrap padding included) and the ring head after it
+		VkDeviceSize ringBytes{ 0 };
+		VkDeviceSize ringEnd{ 0 };
+		// recorded in this order by flush()
+		std::vector<VkImageMemoryBarrier2> imageTransitions{};
+		std::vector<BufferCopy> bufferCopies{};
+		std::vector<ImageCopy> imageCopies{};
+		std::vector<VkImageMemoryBarrier2> imageReleases{};
+		std::vector<VkBufferMemoryBarrier2> bufferAcquires{};
+		std::vector<VkImageMemoryBarrier2> imageAcquires{};
+		// staging buffers of whole image copies larger than the ring, destroyed once the batch completed
+		std::vector<AllocatedBuffer> dedicatedStaging{};
+	};
+
+	// hands out the ticket of the open batch, starting a new one if needed
+	Batch& openBatch();
+	void record(Batch& t_batch);
+	// copies t_size bytes into the ring and returns their offset, submits the open batch and waits for
+	// older ones when the ring is full
+	VkDeviceSize stage(const void* t_data, VkDeviceSize t_size);
+	std::optional<VkDeviceSize> allocateRing(VkDeviceSize t_size);
+	// reclaims the ring space and recycles the command buffers of completed batches
+	void collect();
+
+	VulkanEngine* m_engine{ nullptr };
+	VkQueue m_queue{};
+	uint32_t m_queueFamily{ 0 };
+	uint32_t m_graphicsFamily{ 0 };
+	VkCommandPool m_pool{};
+	VkSemaphore m_semaphore{};
+
+	AllocatedBuffer m_ring{};
+	VkDeviceSize m_ringSize{ 0 };
+	VkDeviceSize m_ringHead{ 0 };
+	VkDeviceSize m_ringTail{ 0 };
+	VkDeviceSize m_ringUsed{ 0 };
+	VkDeviceSize m_maxChunk{ 0 };
+	// minImageTransferGranularity of the upload family, image bands are rounded to it
+	VkExtent3D m_imageGranularity{ 1, 1, 1 };
+
+	Batch m_open{};
+	uint64_t m_nextValue{ 1 };
+	uint64_t m_lastSubmitted{ 0 };
+	// last batch whose acquires were not recorded on the graphics queue yet
+	uint64_t m_pendingWaitValue{ 0 };
+	std::deque<Batch> m_inFlight{};
+	std::vector<VkCommandBuffer> m_freeCommandBuffers{};
+	// acquires of submitted batches not recorded on the graphics queue yet
+	std::vector<VkBufferMemoryBarrier2> m_pendingBufferAcquires{};
+	std::vector<VkImageMemoryBarrier2> m_pendingImageAcquires{};
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <span>
+#include <glm/vec2.hpp>
+
+#include "vk_types.hpp"
+
+class ThreadPool;
+
+// attribute streams of one primitive, tightly packed as copied out of the glTF accessors.
+// a null stream gets the loader default: normal (1, 0, 0), uv (0, 0), color (1, 1, 1, 1)
+struct VertexStreams {
+    const glm::vec3* positions = nullptr;
+    const glm::vec3* normals = nullptr;
+    const glm::vec2* uvs = nullptr;
+    const glm::vec4* colors = nullptr;
+    size_t count = 0;
+};
+
+namespace vkVertex {
+
+    // writes t_streams.count vertices to t_out. with SSE every vertex is built as three 16 byte rows, scalar code otherwise.
+    // t_colorsFromNormals replaces the color with the normal, to look at the normals.
+    // large primitives are split across t_workers when it is not null
+    void interleave(const VertexStreams& t_streams, Vertex* t_out, bool t_colorsFromNormals, ThreadPool* t_workers);
+
+    // adds t_offset to every index in place, 4 at a time with SSE
+    void offsetIndices(uint32_t* t_indices, size_t t_count, uint32_t t_offset, ThreadPool* t_workers);
+
+    // writes the GPUVertexHeader of t_vertices followed by the packed vertices,
+    // t_out holds VertexHeaderSlots + t_vertices.size() entries
+    void pack(std::span<const Vertex> t_vertices, PackedVertex* t_out, ThreadPool* t_workers);
+}
@@ -1,7 +1,12 @@
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
 
 #include "jade_engine.hpp"
 #include "vk_engine.hpp"
+#include "vk_cooked.hpp"
+#include "vk_threads.hpp"
 
 
 void sayHelloFromEngine() {
@@ -29,4 +34,66 @@ void jade::runEngine(){
 void jade::cleanupEngine(){
     std::cout << "Hello from cleanup engine DLL!" << std::endl;
     VulkanEngine::getInstance()->cleanup(); 
-}
\ No newline at end of file
+}
+
+bool jade::cookAssets(const char* sourcePath, const char* destinationPath){
+
+    const std::filesystem::path source(sourcePath);
+    const std::filesystem::path destination(destinationPath);
+
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(source)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(source)) {
+            const std::filesystem::path extension = entry.path().extension();
+            if (entry.is_regular_file() && (extension == ".gltf" || extension == ".glb")) {
+                files.push_back(entry.path());
+            }
+        }
+    }
+    else if (std::filesystem::is_regular_file(source)) {
+        files.push_back(source);
+    }
+    else {
+        std::cout << "Nothing to cook at " << source << std::endl;
+        return false;
+    }
+
+    // the cooked files mirror the layout of the source directory
+    const std::filesystem::path sourceRoot = std::filesystem::is_directory(source) ? source : source.parent_path();
+    std::atomic<uint32_t> failures{ 0 };
+
+    ThreadPool workers;
+    workers.start(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    workers.parallelFor(static_cast<uint32_t>(files.size()), [&](uint32_t i) {
+        // an exception escaping a worker job would terminate the whole batch, every failure is counted instead
+        std::error_code error;
+        const std::filesystem::path relative = std::filesystem::relative(files[i], sourceRoot, error);
+        if (error) {
+            std::cout << ("failed to cook " + files[i].string() + ": " + error.message() + "\n");
+            failures++;
+            return;
+        }
+        std::filesystem::path target = destination / relative;
+        target.replace_extension(cooked::FileExtension);
+        std::filesystem::create_directories(target.parent_path(), error);
+
+        bool succeeded = false;
+        try {
+            succeeded = cooked::cookGltf(files[i], target);
+        }
+        catch (const std::exception& exception) {
+            std::cout << ("failed to cook " + files[i].string() + ": " + exception.what() + "\n");
+        }
+        // one write per line so the output of the workers does not interleave
+        if (succeeded) {
+            std::cout << ("cooked " + files[i].string() + " -> " + target.string() + "\n");
+        }
+        else {
+            std::cout << ("failed to cook " + files[i].string() + "\n");
+            failures++;
+        }
+    });
+    workers.stop();
+
+    return failures == 0;
+}
@@ -0,0 +1,483 @@
+#include "vk_bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <iterator>
+
+#include <glm/geometric.hpp>
+
+namespace {
+	constexpr uint32_t kSahBins = 12;
+
+	glm::vec3 centroid(const AABB& t_bounds) { return (t_bounds.min + t_bounds.max) * 0.5f; }
+
+	AABB emptyBounds()
+	{
+		constexpr float big = std::numeric_limits<float>::max();
+		return AABB{ glm::vec3(big), glm::vec3(-big) };
+	}
+
+	AABB grow(const AABB& t_bounds, const glm::vec3& t_point)
+	{
+		return AABB{ glm::min(t_bounds.min, t_point), glm::max(t_bounds.max, t_point) };
+	}
+}
+
+namespace vkBVH {
+
+	AABB merge(const AABB& t_a, const AABB& t_b)
+	{
+		return AABB{ glm::min(t_a.min, t_b.min), glm::max(t_a.max, t_b.max) };
+	}
+
+	float surfaceArea(const AABB& t_bounds)
+	{
+		glm::vec3 size = glm::max(t_bounds.max - t_bounds.min, glm::vec3(0.f));
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool contains(const AABB& t_outer, const AABB& t_inner)
+	{
+		return t_outer.min.x <= t_inner.min.x && t_outer.min.y <= t_inner.min.y && t_outer.min.z <= t_inner.min.z &&
+			t_outer.max.x >= t_inner.max.x && t_outer.max.y >= t_inner.max.y && t_outer.max.z >= t_inner.max.z;
+	}
+
+	AABB transformBox(const glm::mat4& t_transform, const glm::vec3& t_origin, const glm::vec3& t_extents)
+	{
+		glm::vec3 center = glm::vec3(t_transform * glm::vec4(t_origin, 1.f));
+
+		// extents of the transformed box are the extents projected on the absolute basis
+		glm::vec3 extents{ 0.f };
+		for (int axis = 0; axis < 3; axis++) {
+			extents += glm::abs(glm::vec3(t_transform[axis])) * t_extents[axis];
+		}
+		return AABB{ center - extents, center + extents };
+	}
+}
+
+std::vector<int32_t> SceneBVH::build(std::span<const BVHItem> t_items)
+{
+	clear();
+
+	std::vector<int32_t> proxies(t_items.size(), kNullNode);
+	if (t_items.empty()) {
+		return proxies;
+	}
+
+	std::vector<BVHItem> items(t_items.begin(), t_items.end());
+	for (BVHItem& item : items) {
+		item.bounds = fatten(item.bounds);
+	}
+	std::vector<uint32_t> order(items.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	m_nodes.reserve(items.size() * 2);
+	m_root = buildRange(items, proxies, order, 0, static_cast<uint32_t>(items.size()));
+	m_nodes[m_root].parent = kNullNode;
+	return proxies;
+}
+
+void SceneBVH::clear()
+{
+	m_nodes.clear();
+	m_root = kNullNode;
+	m_freeList = kNullNode;
+}
+
+int32_t SceneBVH::buildRange(std::vector<BVHItem>& t_items, std::vector<int32_t>& t_leaves, std::vector<uint32_t>& t_order, uint32_t t_begin, uint32_t t_end)
+{
+	int32_t nodeIndex = allocateNode();
+
+	if (t_end - t_begin == 1) {
+		uint32_t item = t_order[t_begin];
+		Node& leaf = m_nodes[nodeIndex];
+		leaf.bounds = t_items[item].bounds;
+		leaf.userData = t_items[item].userData;
+		t_leaves[item] = nodeIndex;
+		return nodeIndex;
+	}
+
+	AABB bounds = emptyBounds();
+	AABB centroidBounds = emptyBounds();
+	for (uint32_t i = t_begin; i < t_end; i++) {
+		const AABB& itemBounds = t_items[t_order[i]].bounds;
+		bounds = vkBVH::merge(bounds, itemBounds);
+		centroidBounds = grow(centroidBounds, centroid(itemBounds));
+	}
+
+	// bin the centroids along every axis and keep the split with the lowest SA(L) * N(L) + SA(R) * N(R)
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	glm::vec3 centroidSize = centroidBounds.max - centroidBounds.min;
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (centroidSize[axis] <= 0.f) {
+			continue;
+		}
+
+		AABB binBounds[kSahBins];
+		uint32_t binCounts[kSahBins] = {};
+		std::fill(std::begin(binBounds), std::end(binBounds), emptyBounds());
+
+		float scale = kSahBins / centroidSize[axis];
+		for (uint32_t i = t_begin; i < t_end; i++) {
+			const AABB& itemBounds = t_items[t_order[i]].bounds;
+			uint32_t bin = std::min(kSahBins - 1, static_cast<uint32_t>((centroid(itemBounds)[axis] - centroidBounds.min[axis]) * scale));
+			binCounts[bin]++;
+			binBounds[bin] = vkBVH::merge(binBounds[bin], itemBounds);
+		}
+
+		// sweep from the right to get the cost of every right half, then from the left
+		float rightArea[kSahBins];
+		uint32_t rightCount[kSahBins];
+		AABB accumulated = emptyBounds();
+		uint32_t count = 0;
+		for (uint32_t bin = kSahBins - 1; bin > 0; bin--) {
+			accumulated = vkBVH::merge(accumulated, binBounds[bin]);
+			count += binCounts[bin];
+			rightArea[bin] = vkBVH::surfaceArea(accumulated);
+			rightCount[bin] = count;
+		}
+
+		accumulated = emptyBounds();
+		count = 0;
+		for (uint32_t split = 1; split < kSahBins; split++) {
+			accumulated = vkBVH::merge(accumulated, binBounds[split - 1]);
+			count += binCounts[split - 1];
+			if (count == 0 || rightCount[split] == 0) {
+				continue;
+			}
+			float cost = vkBVH::surfaceArea(accumulated) * count + rightArea[split] * rightCount[split];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis < 0) {
+		// every centroid is at the same spot, any split is as good as the other
+		middle = t_begin + (t_end - t_begin) / 2;
+	}
+	else {
+		float scale = kSahBins / centroidSize[bestAxis];
+		float minimum = centroidBounds.min[bestAxis];
+		auto firstRight = std::partition(t_order.begin() + t_begin, t_order.begin() + t_end, [&](uint32_t item) {
+			uint32_t bin = std::min(kSahBins - 1, static_cast<uint32_t>((centroid(t_items[item].bounds)[bestAxis] - minimum) * scale));
+			return bin < bestSplit;
+		});
+		middle = static_cast<uint32_t>(firstRight - t_order.begin());
+	}
+
+	int32_t left = buildRange(t_items, t_leaves, t_order, t_begin, middle);
+	int32_t right = buildRange(t_items, t_leaves, t_order, middle, t_end);
+
+	// m_nodes may have been reallocated by the recursion
+	Node& node = m_nodes[nodeIndex];
+	node.bounds = bounds;
+	node.left = left;
+	node.right = right;
+	m_nodes[left].parent = nodeIndex;
+	m_nodes[right].parent = nodeIndex;
+	return nodeIndex;
+}
+
+bool SceneBVH::moveProxy(int32_t t_proxy, const AABB& t_bounds)
+{
+	if (vkBVH::contains(m_nodes[t_proxy].bounds, t_bounds)) {
+		return false;
+	}
+
+	removeLeaf(t_proxy);
+	m_nodes[t_proxy].bounds = fatten(t_bounds);
+	insertLeaf(t_proxy);
+	return true;
+}
+
+void SceneBVH::setProxyBounds(int32_t t_proxy, const AABB& t_bounds)
+{
+	m_nodes[t_proxy].bounds = fatten(t_bounds);
+}
+
+void SceneBVH::refit()
+{
+	if (m_root == kNullNode) {
+		return;
+	}
+
+	// children are not guaranteed to be stored after their parents once nodes are recycled, so walk the tree post order
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.push_back({ m_root, false });
+	while (!stack.empty()) {
+		auto [index, childrenDone] = stack.back();
+		stack.pop_back();
+
+		Node& node = m_nodes[index];
+		if (node.isLeaf()) {
+			continue;
+		}
+		if (childrenDone) {
+			node.bounds = vkBVH::merge(m_nodes[node.left].bounds, m_nodes[node.right].bounds);
+		}
+		else {
+			stack.push_back({ index, true });
+			stack.push_back({ node.left, false });
+			stack.push_back({ node.right, false });
+		}
+	}
+}
+
+void SceneBVH::cull(const Frustum& t_frustum, std::vector<uint32_t>& t_out) const
+{
+	if (m_root == kNullNode) {
+		return;
+	}
+
+	int32_t stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = m_root;
+
+	while (stackSize > 0) {
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		glm::vec3 center = centroid(node.bounds);
+		glm::vec3 extents = (node.bounds.max - node.bounds.min) * 0.5f;
+
+		bool outside = false;
+		bool inside = true;
+		for (const glm::vec4& plane : t_frustum.planes) {
+			glm::vec3 normal{ plane };
+			float distance = glm::dot(normal, center) + plane.w;
+			float radius = glm::dot(glm::abs(normal), extents);
+			if (distance + radius < 0.f) {
+				outside = true;
+				break;
+			}
+			if (distance - radius < 0.f) {
+				inside = false;
+			}
+		}
+
+		if (outside) {
+			continue;
+		}
+		if (inside || node.isLeaf()) {
+			if (node.isLeaf()) {
+				t_out.push_back(node.userData);
+			}
+			else {
+				collectLeaves(node.left, t_out);
+				collectLeaves(node.right, t_out);
+			}
+			continue;
+		}
+
+		if (stackSize + 2 > static_cast<int>(std::size(stack))) {
+			// degenerate tree, accept the subtree instead of overflowing
+			collectLeaves(node.left, t_out);
+			collectLeaves(node.right, t_out);
+			continue;
+		}
+		stack[stackSize++] = node.left;
+		stack[stackSize++] = node.right;
+	}
+}
+
+std::optional<BVHRayHit> SceneBVH::raycast(const glm::vec3& t_origin, const glm::vec3& t_direction, float t_maxDistance) const
+{
+	if (m_root == kNullNode) {
+		return std::nullopt;
+	}
+
+	glm::vec3 inverseDirection = 1.f / t_direction;
+
+	// slab test, returns the entry distance or max float on a miss
+	auto intersect = [&](const AABB& bounds, float closest) {
+		glm::vec3 t0 = (bounds.min - t_origin) * inverseDirection;
+		glm::vec3 t1 = (bounds.max - t_origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, closest));
+		return enter <= exit ? enter : std::numeric_limits<float>::max();
+	};
+
+	std::optional<BVHRayHit> hit;
+	float closest = t_maxDistance;
+
+	std::vector<int32_t> stack;
+	stack.push_back(m_root);
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		float distance = intersect(node.bounds, closest);
+		if (distance == std::numeric_limits<float>::max()) {
+			continue;
+		}
+		if (node.isLeaf()) {
+			closest = distance;
+			hit = BVHRayHit{ node.userData, distance };
+			continue;
+		}
+
+		// visit the nearer child first so the farther one is more likely to be pruned
+		float leftDistance = intersect(m_nodes[node.left].bounds, closest);
+		float rightDistance = intersect(m_nodes[node.right].bounds, closest);
+		if (leftDistance < rightDistance) {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+		else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+	return hit;
+}
+
+int32_t SceneBVH::allocateNode()
+{
+	int32_t index;
+	if (m_freeList != kNullNode) {
+		index = m_freeList;
+		m_freeList = m_nodes[index].parent;
+	}
+	else {
+		index = static_cast<int32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+	m_nodes[index] = Node{ emptyBounds(), kNullNode, kNullNode, kNullNode, 0 };
+	return index;
+}
+
+void SceneBVH::freeNode(int32_t t_node)
+{
+	m_nodes[t_node].parent = m_freeList;
+	m_freeList = t_node;
+}
+
+void SceneBVH::insertLeaf(int32_t t_leaf)
+{
+	if (m_root == kNullNode) {
+		m_root = t_leaf;
+		m_nodes[t_leaf].parent = kNullNode;
+		return;
+	}
+
+	// descend towards the sibling that increases the total surface area the least
+	const AABB leafBounds = m_nodes[t_leaf].bounds;
+	int32_t index = m_root;
+	while (!m_nodes[index].isLeaf()) {
+		const Node& node = m_nodes[index];
+		float area = vkBVH::surfaceArea(node.bounds);
+		float combinedArea = vkBVH::surfaceArea(vkBVH::merge(node.bounds, leafBounds));
+
+		// cost of pairing with this node, and the area every deeper choice adds to this node
+		float cost = 2.f * combinedArea;
+		float inheritanceCost = 2.f * (combinedArea - area);
+
+		auto childCost = [&](int32_t child) {
+			AABB merged = vkBVH::merge(leafBounds, m_nodes[child].bounds);
+			float mergedArea = vkBVH::surfaceArea(merged);
+			if (m_nodes[child].isLeaf()) {
+				return mergedArea + inheritanceCost;
+			}
+			return mergedArea - vkBVH::surfaceArea(m_nodes[child].bounds) + inheritanceCost;
+		};
+		float leftCost = childCost(node.left);
+		float rightCost = childCost(node.right);
+
+		if (cost < leftCost && cost < rightCost) {
+			break;
+		}
+		index = leftCost < rightCost ? node.left : node.right;
+	}
+
+	int32_t sibling = index;
+	int32_t oldParent = m_nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].bounds = vkBVH::merge(leafBounds, m_nodes[sibling].bounds);
+	m_nodes[newParent].left = sibling;
+	m_nodes[newParent].right = t_leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[t_leaf].parent = newParent;
+
+	if (oldParent == kNullNode) {
+		m_root = newParent;
+	}
+	else if (m_nodes[oldParent].left == sibling) {
+		m_nodes[oldParent].left = newParent;
+	}
+	else {
+		m_nodes[oldParent].right = newParent;
+	}
+
+	refitUpwards(oldParent);
+}
+
+void SceneBVH::removeLeaf(int32_t t_leaf)
+{
+	if (t_leaf == m_root) {
+		m_root = kNullNode;
+		return;
+	}
+
+	int32_t parent = m_nodes[t_leaf].parent;
+	int32_t grandParent = m_nodes[parent].parent;
+	int32_t sibling = m_nodes[parent].left == t_leaf ? m_nodes[parent].right : m_nodes[parent].left;
+
+	// the sibling takes the place of the parent
+	if (grandParent == kNullNode) {
+		m_root = sibling;
+		m_nodes[sibling].parent = kNullNode;
+	}
+	else {
+		if (m_nodes[grandParent].left == parent) {
+			m_nodes[grandParent].left = sibling;
+		}
+		else {
+			m_nodes[grandParent].right = sibling;
+		}
+		m_nodes[sibling].parent = grandParent;
+		refitUpwards(grandParent);
+	}
+	freeNode(parent);
+	m_nodes[t_leaf].parent = kNullNode;
+}
+
+void SceneBVH::refitUpwards(int32_t t_node)
+{
+	for (int32_t index = t_node; index != kNullNode; index = m_nodes[index].parent) {
+		Node& node = m_nodes[index];
+		node.bounds = vkBVH::merge(m_nodes[node.left].bounds, m_nodes[node.right].bounds);
+	}
+}
+
+void SceneBVH::collectLeaves(int32_t t_node, std::vector<uint32_t>& t_out) const
+{
+	std::vector<int32_t> stack;
+	stack.push_back(t_node);
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (node.isLeaf()) {
+			t_out.push_back(node.userData);
+		}
+		else {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+AABB SceneBVH::fatten(const AABB& t_bounds) const
+{
+	glm::vec3 margin = (t_bounds.max - t_bounds.min) * fatMargin;
+	return AABB{ t_bounds.min - margin, t_bounds.max + margin };
+}
@@ -0,0 +1,546 @@
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include "vk_cooked.hpp"
+#include "vk_engine.hpp"
+#include "vk_mesh_optimizer.hpp"
+#include "vk_vertex_assembly.hpp"
+
+#include <stb_image.h>
+#include <fmt/core.h>
+#include <fstream>
+#include <cstring>
+#include <span>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace cooked {
+
+namespace {
+
+// grows the file in memory, every section starts aligned
+struct FileBuilder {
+	std::vector<uint8_t> bytes;
+
+	template<typename T>
+	Section append(const std::vector<T>& t_elements)
+	{
+		const uint64_t offset = (bytes.size() + SectionAlignment - 1) & ~(SectionAlignment - 1);
+		const uint64_t size = t_elements.size() * sizeof(T);
+		bytes.resize(offset + size);
+		if (size != 0) {
+			std::memcpy(bytes.data() + offset, t_elements.data(), size);
+		}
+		return { offset, size };
+	}
+};
+
+struct NameTable {
+	std::vector<char> chars;
+
+	Name add(std::string_view t_name)
+	{
+		Name name{ static_cast<uint32_t>(chars.size()), static_cast<uint32_t>(t_name.size()) };
+		chars.insert(chars.end(), t_name.begin(), t_name.end());
+		return name;
+	}
+};
+
+template<typename T>
+std::span<const T> view(const MappedFile& t_file, const Section& t_section)
+{
+	return { reinterpret_cast<const T*>(t_file.getData() + t_section.offset), static_cast<size_t>(t_section.size / sizeof(T)) };
+}
+
+bool isValid(const MappedFile& t_file, const Section& t_section, size_t t_elementSize)
+{
+	return t_section.offset % SectionAlignment == 0 && t_section.size % t_elementSize == 0 &&
+		t_section.offset <= t_file.getSize() && t_section.size <= t_file.getSize() - t_section.offset;
+}
+
+} // namespace
+
+bool cookGltf(const std::filesystem::path& t_source, const std::filesystem::path& t_destination)
+{
+	std::optional<fastgltf::Asset> parsed = parseGltf(t_source);
+	if (!parsed.has_value()) {
+		return false;
+	}
+	fastgltf::Asset& gltf = parsed.value();
+
+	// loadPrimitive expects indexed primitives with positions, anything else fails the file instead of throwing
+	for (fastgltf::Mesh& mesh : gltf.meshes) {
+		for (fastgltf::Primitive& p : mesh.primitives) {
+			if (!p.indicesAccessor.has_value() || p.findAttribute("POSITION") == p.attributes.end()) {
+				fmt::println("cooker: mesh {} of {} has a primitive without indices or positions", mesh.name, t_source.string());
+				return false;
+			}
+		}
+	}
+
+	NameTable names;
+
+	std::vector<Sampler> samplers;
+	for (fastgltf::Sampler& sampler : gltf.samplers) {
+		Sampler& cookedSampler = samplers.emplace_back();
+		cookedSampler.magFilter = extractFilter(sampler.magFilter.value_or(fastgltf::Filter::Nearest));
+		cookedSampler.minFilter = extractFilter(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+		cookedSampler.mipmapMode = extractMipmapMode(sampler.minFilter.value_or(fastgltf::Filter::Nearest));
+	}
+
+	// the textures are stored decoded, loading a cooked file never runs stb_image
+	std::vector<Image> images;
+	std::vector<uint8_t> pixels;
+	for (fastgltf::Image& image : gltf.images) {
+		DecodedImage decoded = decodeImage(gltf, image);
+
+		Image& cookedImage = images.emplace_back();
+		cookedImage.name = names.add(image.name);
+		if (decoded.pixels) {
+			const size_t size = static_cast<size_t>(decoded.extent.width) * decoded.extent.height * 4;
+			cookedImage.pixelOffset = (pixels.size() + SectionAlignment - 1) & ~(SectionAlignment - 1);
+			cookedImage.width = decoded.extent.width;
+			cookedImage.height = decoded.extent.height;
+			pixels.resize(cookedImage.pixelOffset + size);
+			std::memcpy(pixels.data() + cookedImage.pixelOffset, decoded.pixels, size);
+			stbi_image_free(decoded.pixels);
+		}
+		else {
+			fmt::println("cooker: failed to decode texture {} of {}", image.name, t_source.string());
+		}
+	}
+
+	std::vector<Material> materials;
+	for (fastgltf::Material& mat : gltf.materials) {
+		Material& cookedMaterial = materials.emplace_back();
+		cookedMaterial.name = names.add(mat.name);
+		cookedMaterial.passType = static_cast<uint32_t>(mat.alphaMode == fastgltf::AlphaMode::Blend ? MaterialPass::Transparent : MaterialPass::MainColor);
+		cookedMaterial.colorFactors = glm::vec4(mat.pbrData.baseColorFactor[0], mat.pbrData.baseColorFactor[1],
+			mat.pbrData.baseColorFactor[2], mat.pbrData.baseColorFactor[3]);
+		cookedMaterial.metalRoughFactors.x = mat.pbrData.metallicFactor;
+		cookedMaterial.metalRoughFactors.y = mat.pbrData.roughnessFactor;
+		if (mat.pbrData.baseColorTexture.has_value()) {
+			fastgltf::Texture& texture = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex];
+			// textures without a sampler (or with only an extension image) keep -1, the loader falls back to the defaults
+			cookedMaterial.colorImage = texture.imageIndex.has_value() ? static_cast<int32_t>(*texture.imageIndex) : -1;
+			cookedMaterial.colorSampler = texture.samplerIndex.has_value() ? static_cast<int32_t>(*texture.samplerIndex) : -1;
+		}
+	}
+
+	std::vector<Mesh> meshes;
+	std::vector<Surface> surfaces;
+	std::vector<PackedVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Vertex> meshVertices;
+	std::vector<uint32_t> meshIndices;
+	std::vector<IndexRange> meshRanges;
+	for (fastgltf::Mesh& mesh : gltf.meshes) {
+		Mesh& cookedMesh = meshes.emplace_back();
+		cookedMesh.name = names.add(mesh.name);
+		cookedMesh.firstSurface = static_cast<uint32_t>(surfaces.size());
+
+		meshVertices.clear();
+		meshIndices.clear();
+		for (auto&& p : mesh.primitives) {
+			Surface& surface = surfaces.emplace_back();
+			surface.startIndex = static_cast<uint32_t>(meshIndices.size());
+			surface.count = static_cast<uint32_t>(gltf.accessors[p.indicesAccessor.value()].count);
+
+			size_t initial_vtx = meshVertices.size();
+			loadPrimitive(gltf, p, meshIndices, meshVertices);
+
+			// same fallback as the glTF loader, primitives without a material use the first one
+			surface.material = p.materialIndex.has_value() ? static_cast<int32_t>(p.materialIndex.value()) : (materials.empty() ? -1 : 0);
+			surface.bounds = computeBounds(std::span<const Vertex>(meshVertices).subspan(initial_vtx));
+		}
+
+		// cooked meshes are always optimized, the cost is paid once offline
+		meshRanges.clear();
+		for (size_t i = cookedMesh.firstSurface; i < surfaces.size(); i++) {
+			meshRanges.push_back({ surfaces[i].startIndex, surfaces[i].count, mesh.primitives[i - cookedMesh.firstSurface].type });
+		}
+		vkMesh::optimizeMesh(meshIndices, meshVertices, meshRanges);
+
+		cookedMesh.surfaceCount = static_cast<uint32_t>(surfaces.size()) - cookedMesh.firstSurface;
+		cookedMesh.firstVertex = static_cast<uint32_t>(vertices.size());
+		cookedMesh.vertexCount = VertexHeaderSlots + static_cast<uint32_t>(meshVertices.size());
+		cookedMesh.firstIndex = static_cast<uint32_t>(indices.size());
+		cookedMesh.indexCount = static_cast<uint32_t>(meshIndices.size());
+		vertices.resize(vertices.size() + cookedMesh.vertexCount);
+		vkVertex::pack(meshVertices, vertices.data() + cookedMesh.firstVertex, nullptr);
+		indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+	}
+
+	// flatten the tree breadth first, the same order the glTF loader builds its hierarchy in
+	std::vector<int32_t> gltfParents(gltf.nodes.size(), -1);
+	for (size_t i = 0; i < gltf.nodes.size(); i++) {
+		for (auto& c : gltf.nodes[i].children) {
+			gltfParents[c] = static_cast<int32_t>(i);
+		}
+	}
+	std::vector<uint32_t> pending;
+	std::vector<int32_t> flatIndices(gltf.nodes.size(), -1);
+	for (uint32_t i = 0; i < gltf.nodes.size(); i++) {
+		if (gltfParents[i] < 0) {
+			pending.push_back(i);
+		}
+	}
+
+	std::vector<Node> nodes;
+	for (size_t cursor = 0; cursor < pending.size(); cursor++) {
+		const uint32_t gltfIndex = pending[cursor];
+		fastgltf::Node& node = gltf.nodes[gltfIndex];
+
+		flatIndices[gltfIndex] = static_cast<int32_t>(nodes.size());
+		Node& cookedNode = nodes.emplace_back();
+		cookedNode.name = names.add(node.name);
+		cookedNode.parent = gltfParents[gltfIndex] < 0 ? -1 : flatIndices[gltfParents[gltfIndex]];
+		cookedNode.meshIndex = node.meshIndex.has_value() ? static_cast<int32_t>(*node.meshIndex) : -1;
+
+		std::visit(fastgltf::visitor {
+			[&](fastgltf::math::fmat4x4 matrix) {
+				std::memcpy(&cookedNode.localMatrix, matrix.data(), sizeof(matrix));
+
+				const Transformation transform = decomposeNodeMatrix(cookedNode.localMatrix, node.name);
+				cookedNode.translation = transform.getPositionR();
+				cookedNode.rotation = transform.getRotationR();
+				cookedNode.scale = transform.getScaleR();
+			},
+			[&](fastgltf::TRS transform) {
+				cookedNode.translation = glm::vec3(transform.translation[0], transform.translation[1], transform.translation[2]);
+				cookedNode.rotation = glm::quat(transform.rotation[3], transform.rotation[0], transform.rotation[1], transform.rotation[2]);
+				cookedNode.scale = glm::vec3(transform.scale[0], transform.scale[1], transform.scale[2]);
+				cookedNode.localMatrix = Transformation(cookedNode.translation, cookedNode.rotation, cookedNode.scale).getTransformationMatrix();
+			}
+		},
+		node.transform);
+
+		for (auto& c : node.children) {
+			pending.push_back(static_cast<uint32_t>(c));
+		}
+	}
+
+	FileBuilder builder;
+	Header header{};
+	builder.bytes.resize(sizeof(Header));
+	header.samplers = builder.append(samplers);
+	header.images = builder.append(images);
+	header.materials = builder.append(materials);
+	header.meshes = builder.append(meshes);
+	header.surfaces = builder.append(surfaces);
+	header.nodes = builder.append(nodes);
+	header.vertices = builder.append(vertices);
+	header.indices = builder.append(indices);
+	header.pixels = builder.append(pixels);
+	header.names = builder.append(names.chars);
+	std::memcpy(builder.bytes.data(), &header, sizeof(Header));
+
+	// written next to the destination and renamed, a loader never sees a half written file
+	std::filesystem::path temporary = t_destination;
+	temporary += ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			fmt::println("cooker: failed to open {}", temporary.string());
+			return false;
+		}
+		out.write(reinterpret_cast<const char*>(builder.bytes.data()), static_cast<std::streamsize>(builder.bytes.size()));
+		if (!out) {
+			fmt::println("cooker: failed to write {}", temporary.string());
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, t_destination, error);
+	if (error) {
+		fmt::println("cooker: failed to move {} to {}: {}", temporary.string(), t_destination.string(), error.message());
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::open(const std::filesystem::path& t_path)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileW(t_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	int file = ::open(t_path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	struct stat info{};
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		::close(file);
+		return false;
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	// the mapping keeps the file alive
+	::close(file);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	// the sections are read front to back once
+	madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(info.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+	m_file = nullptr;
+	m_mapping = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+} // namespace cooked
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadCookedGltf(VulkanEngine* engine, const std::filesystem::path& path)
+{
+	fmt::print("Loading cooked scene: {}", path.string());
+
+	cooked::MappedFile mapped;
+	if (!mapped.open(path)) {
+		fmt::println("Failed to map {}", path.string());
+		return {};
+	}
+
+	cooked::Header header{};
+	if (mapped.getSize() < sizeof(cooked::Header)) {
+		fmt::println("Cooked scene {} is truncated", path.string());
+		return {};
+	}
+	std::memcpy(&header, mapped.getData(), sizeof(cooked::Header));
+	if (header.magic != cooked::FileMagic || header.version != cooked::FileVersion || header.vertexSize != sizeof(PackedVertex)) {
+		fmt::println("Cooked scene {} is stale, cook it again", path.string());
+		return {};
+	}
+	if (!cooked::isValid(mapped, header.samplers, sizeof(cooked::Sampler)) || !cooked::isValid(mapped, header.images, sizeof(cooked::Image)) ||
+		!cooked::isValid(mapped, header.materials, sizeof(cooked::Material)) || !cooked::isValid(mapped, header.meshes, sizeof(cooked::Mesh)) ||
+		!cooked::isValid(mapped, header.surfaces, sizeof(cooked::Surface)) || !cooked::isValid(mapped, header.nodes, sizeof(cooked::Node)) ||
+		!cooked::isValid(mapped, header.vertices, sizeof(PackedVertex)) || !cooked::isValid(mapped, header.indices, sizeof(uint32_t)) ||
+		!cooked::isValid(mapped, header.pixels, 1) || !cooked::isValid(mapped, header.names, 1)) {
+		fmt::println("Cooked scene {} is corrupt", path.string());
+		return {};
+	}
+
+	std::span<const cooked::Sampler> samplers = cooked::view<cooked::Sampler>(mapped, header.samplers);
+	std::span<const cooked::Image> images = cooked::view<cooked::Image>(mapped, header.images);
+	std::span<const cooked::Material> materials = cooked::view<cooked::Material>(mapped, header.materials);
+	std::span<const cooked::Mesh> meshes = cooked::view<cooked::Mesh>(mapped, header.meshes);
+	std::span<const cooked::Surface> surfaces = cooked::view<cooked::Surface>(mapped, header.surfaces);
+	std::span<const cooked::Node> nodes = cooked::view<cooked::Node>(mapped, header.nodes);
+	std::span<const PackedVertex> vertices = cooked::view<PackedVertex>(mapped, header.vertices);
+	std::span<const uint32_t> indices = cooked::view<uint32_t>(mapped, header.indices);
+	const uint8_t* pixels = mapped.getData() + header.pixels.offset;
+	const char* nameChars = reinterpret_cast<const char*>(mapped.getData() + header.names.offset);
+
+	// cross references are checked up front so a bad file does not leave half a scene behind
+	for (const cooked::Mesh& mesh : meshes) {
+		if (uint64_t(mesh.firstSurface) + mesh.surfaceCount > surfaces.size() || uint64_t(mesh.firstVertex) + mesh.vertexCount > vertices.size() ||
+			mesh.vertexCount < VertexHeaderSlots ||
+			uint64_t(mesh.firstIndex) + mesh.indexCount > indices.size()) {
+			fmt::println("Cooked scene {} is corrupt", path.string());
+			return {};
+		}
+		// surfaces must stay inside the index range of their mesh, the arena is shared with other meshes
+		for (const cooked::Surface& surface : surfaces.subspan(mesh.firstSurface, mesh.surfaceCount)) {
+			if (uint64_t(surface.startIndex) + surface.count > mesh.indexCount) {
+				fmt::println("Cooked scene {} is corrupt", path.string());
+				return {};
+			}
+		}
+		// index values too, the vertex fetch in the shaders reads past the mesh otherwise
+		const uint32_t meshVertexCount = mesh.vertexCount - VertexHeaderSlots;
+		for (uint32_t index : indices.subspan(mesh.firstIndex, mesh.indexCount)) {
+			if (index >= meshVertexCount) {
+				fmt::println("Cooked scene {} is corrupt", path.string());
+				return {};
+			}
+		}
+	}
+	for (const cooked::Material& material : materials) {
+		if (material.passType > static_cast<uint32_t>(MaterialPass::Other)) {
+			fmt::println("Cooked scene {} is corrupt", path.string());
+			return {};
+		}
+	}
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].parent < -1 || nodes[i].parent >= static_cast<int32_t>(i) ||
+			nodes[i].meshIndex < -1 || nodes[i].meshIndex >= static_cast<int32_t>(meshes.size())) {
+			fmt::println("Cooked scene {} is corrupt", path.string());
+			return {};
+		}
+	}
+
+	auto getName = [&](const cooked::Name& name) {
+		return uint64_t(name.offset) + name.length <= header.names.size ? std::string(nameChars + name.offset, name.length) : std::string();
+	};
+
+	std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
+	scene->creator = engine;
+	scene->sceneId = engine->nextSceneId++;
+	LoadedGLTF& file = *scene.get();
+
+	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }
+	};
+	file.descriptorPool.init(engine->device, static_cast<uint32_t>(materials.size()), sizes);
+
+	for (const cooked::Sampler& sampler : samplers) {
+		VkSamplerCreateInfo sampl = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, .pNext = nullptr };
+		sampl.maxLod = VK_LOD_CLAMP_NONE;
+		sampl.minLod = 0;
+		sampl.magFilter = static_cast<VkFilter>(sampler.magFilter);
+		sampl.minFilter = static_cast<VkFilter>(sampler.minFilter);
+		sampl.mipmapMode = static_cast<VkSamplerMipmapMode>(sampler.mipmapMode);
+
+		VkSampler newSampler;
+		vkCreateSampler(engine->device, &sampl, nullptr, &newSampler);
+		file.samplers.push_back(newSampler);
+	}
+
+	// the pixels are copied from the mapping straight into the staging ring
+	std::vector<AllocatedImage> loadedImages;
+	for (const cooked::Image& image : images) {
+		const uint64_t size = static_cast<uint64_t>(image.width) * image.height * 4;
+		if (image.width == 0 || image.pixelOffset + size > header.pixels.size) {
+			loadedImages.push_back(engine->errorCheckerboardImage);
+			continue;
+		}
+		VkExtent3D extent{ image.width, image.height, 1 };
+		AllocatedImage newImage = engine->createImage(const_cast<uint8_t*>(pixels + image.pixelOffset), extent, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, false);
+		loadedImages.push_back(newImage);
+		file.images[getName(image.name)] = newImage;
+	}
+
+	file.materialCount = static_cast<uint32_t>(materials.size());
+	file.firstMaterialIndex = engine->metalRoughMaterial.materialTable.allocate(file.materialCount);
+	std::vector<std::shared_ptr<GLTFMaterial>> loadedMaterials;
+	for (uint32_t i = 0; i < materials.size(); i++) {
+		const cooked::Material& material = materials[i];
+
+		std::shared_ptr<GLTFMaterial> newMat = std::make_shared<GLTFMaterial>();
+		loadedMaterials.push_back(newMat);
+		file.materials[getName(material.name)] = newMat;
+
+		GLTFMetallic_Roughness::MaterialResources materialResources;
+		materialResources.colorImage = engine->whiteImage;
+		materialResources.colorSampler = engine->defaultSamplerLinear;
+		materialResources.metalRoughImage = engine->whiteImage;
+		materialResources.metalRoughSampler = engine->defaultSamplerLinear;
+		materialResources.colorFactors = material.colorFactors;
+		materialResources.metalRoughFactors = material.metalRoughFactors;
+		materialResources.materialIndex = file.firstMaterialIndex + i;
+		if (material.colorImage >= 0 && static_cast<size_t>(material.colorImage) < loadedImages.size()) {
+			materialResources.colorImage = loadedImages[material.colorImage];
+			// -1 keeps the default sampler
+			if (material.colorSampler >= 0 && static_cast<size_t>(material.colorSampler) < file.samplers.size()) {
+				materialResources.colorSampler = file.samplers[material.colorSampler];
+			}
+		}
+
+		newMat->data = engine->metalRoughMaterial.writeMaterial(engine->device, static_cast<MaterialPass>(material.passType), materialResources, file.descriptorPool);
+	}
+
+	// vertices and indices go from the mapping into the staging ring without an intermediate copy
+	for (const cooked::Mesh& mesh : meshes) {
+		std::shared_ptr<MeshAsset> newmesh = std::make_shared<MeshAsset>();
+		newmesh->name = getName(mesh.name);
+		file.meshList.push_back(newmesh);
+		file.meshes[newmesh->name] = newmesh;
+
+		for (const cooked::Surface& surface : surfaces.subspan(mesh.firstSurface, mesh.surfaceCount)) {
+			GeoSurface newSurface;
+			newSurface.startIndex = surface.startIndex;
+			newSurface.count = surface.count;
+			newSurface.bounds = surface.bounds;
+			if (surface.material >= 0 && static_cast<size_t>(surface.material) < loadedMaterials.size()) {
+				newSurface.material = loadedMaterials[surface.material];
+			}
+			newmesh->surfaces.push_back(newSurface);
+		}
+
+		newmesh->meshBuffers = engine->uploadMesh(indices.subspan(mesh.firstIndex, mesh.indexCount), vertices.subspan(mesh.firstVertex, mesh.vertexCount));
+	}
+
+	// the nodes are stored flattened already, parents before children
+	std::vector<std::shared_ptr<Node>> loadedNodes;
+	for (const cooked::Node& node : nodes) {
+		std::shared_ptr<Node> newNode;
+		if (node.meshIndex >= 0) {
+			newNode = std::make_shared<MeshNode>();
+			static_cast<MeshNode*>(newNode.get())->mesh = file.meshList[node.meshIndex];
+		} else {
+			newNode = std::make_shared<Node>();
+		}
+		newNode->localTransform = node.localMatrix;
+
+		const std::string name = getName(node.name);
+		if (node.parent >= 0) {
+			loadedNodes[node.parent]->children.push_back(newNode);
+			newNode->parent = loadedNodes[node.parent];
+		} else {
+			file.topNodes.push_back(newNode);
+		}
+		loadedNodes.push_back(newNode);
+		file.nodes[name] = newNode;
+
+		file.hierarchy.addNode(node.parent, Transformation(node.translation, node.rotation, node.scale), node.meshIndex, name);
+	}
+
+	for (auto& node : file.topNodes) {
+		node->refreshTransform(glm::mat4 { 1.f });
+	}
+	file.hierarchy.refreshTransforms(file.changedNodes);
+
+	file.buildBVH();
+
+	// every copy is staged already, the mapping can go
+	file.uploadTicket = engine->uploadQueue.flush();
+	return scene;
+}
@@ -0,0 +1,163 @@
+#include "vk_culling.hpp"
+
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define JADE_CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define JADE_CULL_SSE
+#endif
+
+void SphereBatch::clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+	visible.clear();
+}
+
+void SphereBatch::push(const glm::vec4& t_sphere)
+{
+	centerX.push_back(t_sphere.x);
+	centerY.push_back(t_sphere.y);
+	centerZ.push_back(t_sphere.z);
+	radius.push_back(t_sphere.w);
+}
+
+namespace vkCull {
+
+	Frustum extractFrustum(const glm::mat4& t_viewProjection)
+	{
+		// glm is column major, gather the rows of the matrix
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++) {
+			row[i] = glm::vec4(t_viewProjection[0][i], t_viewProjection[1][i], t_viewProjection[2][i], t_viewProjection[3][i]);
+		}
+
+		Frustum frustum{};
+		frustum.planes[0] = row[3] + row[0]; // left
+		frustum.planes[1] = row[3] - row[0]; // right
+		frustum.planes[2] = row[3] + row[1]; // bottom
+		frustum.planes[3] = row[3] - row[1]; // top
+		frustum.planes[4] = row[2];          // z >= 0
+		frustum.planes[5] = row[3] - row[2]; // z <= w
+
+		for (glm::vec4& plane : frustum.planes) {
+			float length = glm::length(glm::vec3(plane));
+			if (length > 0.f) {
+				plane /= length;
+			}
+		}
+		return frustum;
+	}
+
+	glm::vec4 transformSphere(const glm::mat4& t_transform, const glm::vec3& t_origin, float t_radius)
+	{
+		glm::vec3 center = glm::vec3(t_transform * glm::vec4(t_origin, 1.f));
+
+		// non uniform scale grows the sphere by the largest axis scale
+		float maxScale = std::max({ glm::length(glm::vec3(t_transform[0])),
+			glm::length(glm::vec3(t_transform[1])),
+			glm::length(glm::vec3(t_transform[2])) });
+
+		return glm::vec4(center, t_radius * maxScale);
+	}
+
+	size_t testSpheres(const Frustum& t_frustum, SphereBatch& t_batch)
+	{
+		const size_t count = t_batch.size();
+		t_batch.visible.resize(count);
+
+		const float* x = t_batch.centerX.data();
+		const float* y = t_batch.centerY.data();
+		const float* z = t_batch.centerZ.data();
+		const float* r = t_batch.radius.data();
+		uint8_t* visible = t_batch.visible.data();
+
+		size_t i = 0;
+
+#if defined(JADE_CULL_AVX)
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm256_set1_ps(t_frustum.planes[p].x);
+			planeY[p] = _mm256_set1_ps(t_frustum.planes[p].y);
+			planeZ[p] = _mm256_set1_ps(t_frustum.planes[p].z);
+			planeW[p] = _mm256_set1_ps(t_frustum.planes[p].w);
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (; i + 8 <= count; i += 8) {
+			const __m256 cx = _mm256_loadu_ps(x + i);
+			const __m256 cy = _mm256_loadu_ps(y + i);
+			const __m256 cz = _mm256_loadu_ps(z + i);
+			const __m256 negRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(r + i));
+
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (int p = 0; p < 6; p++) {
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(planeX[p], cx), planeW[p]);
+				distance = _mm256_add_ps(_mm256_mul_ps(planeY[p], cy), distance);
+				distance = _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), distance);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			}
+
+			const int mask = _mm256_movemask_ps(inside);
+			for (int lane = 0; lane < 8; lane++) {
+				visible[i + lane] = (mask >> lane) & 1;
+			}
+		}
+#elif defined(JADE_CULL_SSE)
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm_set1_ps(t_frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(t_frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(t_frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(t_frustum.planes[p].w);
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4) {
+			const __m128 cx = _mm_loadu_ps(x + i);
+			const __m128 cy = _mm_loadu_ps(y + i);
+			const __m128 cz = _mm_loadu_ps(z + i);
+			const __m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(r + i));
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (int p = 0; p < 6; p++) {
+				__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], cx), planeW[p]);
+				distance = _mm_add_ps(_mm_mul_ps(planeY[p], cy), distance);
+				distance = _mm_add_ps(_mm_mul_ps(planeZ[p], cz), distance);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+			}
+
+			const int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; lane++) {
+				visible[i + lane] = (mask >> lane) & 1;
+			}
+		}
+#endif
+
+		// scalar tail, and the whole batch when no simd is available
+		for (; i < count; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6; p++) {
+				const glm::vec4& plane = t_frustum.planes[p];
+				if (plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w < -r[i]) {
+					inside = false;
+					break;
+				}
+			}
+			visible[i] = inside ? 1 : 0;
+		}
+
+		size_t visibleCount = 0;
+		for (uint8_t v : t_batch.visible) {
+			visibleCount += v;
+		}
+		return visibleCount;
+	}
+}
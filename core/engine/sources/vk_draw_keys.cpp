@@ -0,0 +1,95 @@
+#include "vk_draw_keys.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace vkDraw {
+
+	namespace {
+		constexpr uint64_t mask(uint32_t t_bits) { return (uint64_t(1) << t_bits) - 1; }
+	}
+
+	uint16_t quantizeDepth(float t_viewDepth, float t_maxDepth)
+	{
+		if (!(t_viewDepth > 0.f) || t_maxDepth <= 0.f) {
+			return 0;
+		}
+		const float normalized = std::min(t_viewDepth / t_maxDepth, 1.f);
+		return static_cast<uint16_t>(normalized * float(mask(kDepthBits)));
+	}
+
+	uint64_t makeOpaqueKey(uint32_t t_pipelineId, uint32_t t_materialId, uint32_t t_meshId, uint32_t t_surfaceIndex, uint16_t t_depth)
+	{
+		uint64_t key = 0;
+		key |= (uint64_t(t_pipelineId) & mask(kPipelineBits)) << (kMaterialBits + kMeshBits + kSurfaceBits + kDepthBits);
+		key |= (uint64_t(t_materialId) & mask(kMaterialBits)) << (kMeshBits + kSurfaceBits + kDepthBits);
+		key |= (uint64_t(t_meshId) & mask(kMeshBits)) << (kSurfaceBits + kDepthBits);
+		key |= (uint64_t(t_surfaceIndex) & mask(kSurfaceBits)) << kDepthBits;
+		key |= uint64_t(t_depth);
+		return key;
+	}
+
+	uint64_t makeTransparentKey(uint32_t t_pipelineId, uint32_t t_materialId, uint32_t t_meshId, uint32_t t_surfaceIndex, uint16_t t_depth)
+	{
+		// far objects first, so invert the depth bucket
+		const uint64_t invertedDepth = mask(kDepthBits) - t_depth;
+
+		uint64_t key = 0;
+		key |= invertedDepth << (kPipelineBits + kMaterialBits + kMeshBits + kSurfaceBits);
+		key |= (uint64_t(t_pipelineId) & mask(kPipelineBits)) << (kMaterialBits + kMeshBits + kSurfaceBits);
+		key |= (uint64_t(t_materialId) & mask(kMaterialBits)) << (kMeshBits + kSurfaceBits);
+		key |= (uint64_t(t_meshId) & mask(kMeshBits)) << kSurfaceBits;
+		key |= (uint64_t(t_surfaceIndex) & mask(kSurfaceBits));
+		return key;
+	}
+
+	void radixSort(std::vector<DrawKey>& t_keys, std::vector<DrawKey>& t_scratch)
+	{
+		const size_t count = t_keys.size();
+		if (count < 2) {
+			return;
+		}
+		t_scratch.resize(count);
+
+		// build the histograms of all 8 digits in a single pass over the keys
+		std::array<std::array<uint32_t, 256>, 8> histograms{};
+		for (const DrawKey& k : t_keys) {
+			for (uint32_t pass = 0; pass < 8; pass++) {
+				histograms[pass][(k.key >> (pass * 8)) & 0xFF]++;
+			}
+		}
+
+		DrawKey* src = t_keys.data();
+		DrawKey* dst = t_scratch.data();
+
+		for (uint32_t pass = 0; pass < 8; pass++) {
+			std::array<uint32_t, 256>& histogram = histograms[pass];
+
+			// every key lands in the same bucket, this digit does not change the order
+			const uint32_t firstDigit = (src[0].key >> (pass * 8)) & 0xFF;
+			if (histogram[firstDigit] == count) {
+				continue;
+			}
+
+			// exclusive prefix sum gives the output offset of each bucket
+			uint32_t offset = 0;
+			for (uint32_t& bucket : histogram) {
+				const uint32_t bucketCount = bucket;
+				bucket = offset;
+				offset += bucketCount;
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				const uint32_t digit = (src[i].key >> (pass * 8)) & 0xFF;
+				dst[histogram[digit]++] = src[i];
+			}
+			std::swap(src, dst);
+		}
+
+		// odd number of executed passes leaves the result in the scratch buffer
+		if (src != t_keys.data()) {
+			std::memcpy(t_keys.data(), src, count * sizeof(DrawKey));
+		}
+	}
+}
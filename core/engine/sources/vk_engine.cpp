@@ -2,6 +2,7 @@
 
 #include <thread>
 #include <algorithm>
+#include <limits>
 
 #include <SDL.h>
 #include <SDL_vulkan.h>
@@ -18,11 +19,14 @@
 #include "vk_images.hpp"
 #include "vk_initializers.hpp"
 #include "vk_pipelines.hpp"
+#include "vk_vertex_assembly.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 
 
 constexpr bool bUseValidationLayers = false;
+// view distance that is mapped onto the 16 bit depth range of the draw sort keys
+constexpr float kDrawSortDepthRange = 1000.f;
 
 VulkanEngine* VulkanEngine::instance_{nullptr};
 std::mutex VulkanEngine::mutex_;
@@ -79,6 +83,9 @@ bool VulkanEngine::init(jade::EngineCreateInfo createInfo)
 	
 
 
+	// workers for parallel command recording and texture decoding, the main thread takes part as well
+	workerThreads.start(std::clamp(std::thread::hardware_concurrency(), 2u, 9u) - 1);
+
     initVulkan();
     initSwapchain();
     initCommands();
@@ -109,6 +116,8 @@ bool VulkanEngine::init(jade::EngineCreateInfo createInfo)
     assert(structureFile.has_value());
 
     loadedScenes["structure"] = *structureFile;
+    // the structure never moves, it can be drawn from pre-recorded command buffers
+    loadedScenes["structure"]->isStatic = true;
 
     isInitialized = true;
 	return isInitialized;
@@ -122,14 +131,27 @@ void VulkanEngine::cleanup()
 		
 		loadedScenes.clear();
 
+		workerThreads.stop();
+
 		for (int i = 0; i < FRAME_OVERLAP; i++) {
 			vkDestroyCommandPool(device, frames[i].commandPool, nullptr);
+			for (VkCommandPool pool : frames[i].recordPools) {
+				vkDestroyCommandPool(device, pool, nullptr);
+			}
+			vkDestroyCommandPool(device, frames[i].staticPool, nullptr);
 
 			//destroy sync objects
 			vkDestroyFence(device, frames[i].renderFence, nullptr);
 			vkDestroySemaphore(device, frames[i].renderSemaphore, nullptr);
 			vkDestroySemaphore(device ,frames[i].swapchainSemaphore, nullptr);
 			frames[i].deletionQueue.flush();
+
+			for (AllocatedBuffer* buffer : { &frames[i].instanceBuffer, &frames[i].objectBuffer, &frames[i].drawCommandBuffer, &frames[i].drawCountBuffer,
+				&frames[i].transformScatterBuffer, &frames[i].staticInstanceBuffer }) {
+				if (buffer->buffer != VK_NULL_HANDLE) {
+					destroyBuffer(*buffer);
+				}
+			}
 		}
 		metalRoughMaterial.clearResources(device);
 		mainDeletionQueue.flush();
@@ -154,6 +176,8 @@ void VulkanEngine::draw()
 
 	getCurrentFrame().deletionQueue.flush();
 	getCurrentFrame().frameDescriptors.clearPools(device);
+	// the material writes since this frame's copy of the table was last used
+	metalRoughMaterial.materialTable.beginFrame(frameNumber % FRAME_OVERLAP);
 
 	VK_CHECK(vkResetFences(device, 1, &getCurrentFrame().renderFence));
 
@@ -184,11 +208,18 @@ void VulkanEngine::draw()
 	//start the command buffer recording
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+	// submit what was uploaded since the last frame and take ownership of it on the graphics queue
+	uploadQueue.flush();
+	const uint64_t uploadWaitValue = uploadQueue.recordAcquires(cmd);
+
     //make the swapchain image into writeable mode before rendering
 	vkUtil::transition_image(cmd, drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
 
 	drawBackground(cmd);
+	//sorting and buffer writes, and the culling dispatch when the gpu driven path is enabled.
+	//compute work has to be recorded outside of the render pass
+	prepareGeometry(cmd);
 	vkUtil::transition_image(cmd, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	vkUtil::transition_image(cmd, depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 	{
@@ -199,6 +230,10 @@ void VulkanEngine::draw()
 
 
 		VkRenderingInfo renderInfo = vkInit::renderingInfo(drawExtent, &colorAttachment, &depthAttachment);
+		if (recordsSecondaries()) {
+			// the draws come from secondary command buffers, recorded on the worker threads or ahead of time
+			renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+		}
 		vkCmdBeginRendering(cmd, &renderInfo);
 		drawGeometry(cmd);
 		vkCmdEndRendering(cmd);
@@ -231,6 +266,14 @@ void VulkanEngine::draw()
 	
 	VkSubmitInfo2 submit = vkInit::submit_info(&cmdinfo,&signalInfo,&waitInfo);	
 
+	// wait for uploads that are still running on the transfer queue
+	VkSemaphoreSubmitInfo waitInfos[2] = { waitInfo, vkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, uploadQueue.getSemaphore()) };
+	waitInfos[1].value = uploadWaitValue;
+	if (uploadWaitValue != 0) {
+		submit.waitSemaphoreInfoCount = 2;
+		submit.pWaitSemaphoreInfos = waitInfos;
+	}
+
 	//submit command buffer to the queue and execute it.
 	// _renderFence will now block until the graphic commands finish execution
 	VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submit, getCurrentFrame().renderFence));
@@ -288,6 +331,9 @@ void VulkanEngine::run()
 						stopRendering = false;
 					}
 				}
+				if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT && !ImGui::GetIO().WantCaptureMouse) {
+					pickScene(e.button.x, e.button.y);
+				}
 				camera.processSDLEvent(e);
 				//send SDL event to imgui for handling
 				ImGui_ImplSDL2_ProcessEvent(&e);
@@ -339,6 +385,18 @@ void VulkanEngine::run()
 				ImGui::Text("update time %f ms", stats.scene_update_time);
 				ImGui::Text("triangles %i", stats.triangle_count);
 				ImGui::Text("draws %i", stats.drawcall_count);
+				ImGui::Text("culled %i", stats.culled_count);
+				ImGui::Text("host visible vram %s", hostVisibleDeviceMemory ? "yes" : "no");
+				ImGui::Checkbox("frustum culling", &useFrustumCulling);
+				ImGui::Checkbox("gpu driven", &useGpuDrivenRendering);
+				ImGui::Checkbox("gpu transforms", &useGpuTransforms);
+				ImGui::Checkbox("parallel recording", &useParallelRecording);
+				ImGui::Checkbox("static bundles (without culling)", &useStaticBundles);
+				if (ImGui::Checkbox("bindless materials", &useBindlessMaterials)) {
+					// the static bundles have the material binds recorded
+					staticGeneration++;
+				}
+				ImGui::Text("picked %s", pickedNodeName.empty() ? "-" : pickedNodeName.c_str());
 			}
 			ImGui::End();
 			//make imgui calculate internal draw structures
@@ -387,6 +445,18 @@ void VulkanEngine::initVulkan()
 	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.drawIndirectCount = true;
+	features12.timelineSemaphore = true;
+	// bindless material textures
+	features12.runtimeDescriptorArray = true;
+	features12.descriptorBindingPartiallyBound = true;
+	features12.descriptorBindingSampledImageUpdateAfterBind = true;
+	features12.shaderSampledImageArrayNonUniformIndexing = true;
+
+	//vulkan 1.0 features
+	VkPhysicalDeviceFeatures features{};
+	// the commands written by cull.comp select the instance of the draw with firstInstance
+	features.drawIndirectFirstInstance = true;
 
 
 	//use vkbootstrap to select a gpu. 
@@ -396,6 +466,7 @@ void VulkanEngine::initVulkan()
 		.set_minimum_version(1, 3)
 		.set_required_features_13(features13)
 		.set_required_features_12(features12)
+		.set_required_features(features)
 		.set_surface(surface)
 		.select()
 		.value();
@@ -414,6 +485,17 @@ void VulkanEngine::initVulkan()
 	graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+	// uploads go to a dedicated transfer queue when the device has one, otherwise they share the graphics queue
+	auto dedicatedTransfer = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+	if (dedicatedTransfer.has_value()) {
+		transferQueue = dedicatedTransfer.value();
+		transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+	}
+	else {
+		transferQueue = graphicsQueue;
+		transferQueueFamily = graphicsQueueFamily;
+	}
+
 	
     VmaAllocatorCreateInfo allocatorInfo = {};
     allocatorInfo.physicalDevice = chosenGPU;
@@ -426,6 +508,32 @@ void VulkanEngine::initVulkan()
         vmaDestroyAllocator(allocator);
     });
 
+	// a small 256MB bar window is a heap of its own, only count it when the largest device local heap is
+	// host visible so geometry does not eat into it
+	const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+	vmaGetMemoryProperties(allocator, &memoryProperties);
+	uint32_t largestHeap = UINT32_MAX;
+	for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+		const VkMemoryHeap& heap = memoryProperties->memoryHeaps[i];
+		if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+			(largestHeap == UINT32_MAX || heap.size > memoryProperties->memoryHeaps[largestHeap].size)) {
+			largestHeap = i;
+		}
+	}
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+		const VkMemoryType& type = memoryProperties->memoryTypes[i];
+		const VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		if (type.heapIndex == largestHeap && (type.propertyFlags & wanted) == wanted) {
+			hostVisibleDeviceMemory = true;
+		}
+	}
+
+	// 64MB of persistently mapped staging memory shared by every upload
+	uploadQueue.init(this, transferQueue, transferQueueFamily, graphicsQueueFamily, 64ull * 1024 * 1024);
+	mainDeletionQueue.pushFunction([=, this]() {
+		uploadQueue.destroy();
+	});
+
 
 }
 
@@ -507,6 +615,22 @@ void VulkanEngine::initCommands()
 		VkCommandBufferAllocateInfo cmdAllocInfo = vkInit::command_buffer_allocate_info(frames[i].commandPool,1);
 
 		VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frames[i].mainCommandBuffer));
+
+		// one pool per recording job, the pools are reset as a whole every frame
+		VkCommandPoolCreateInfo recordPoolCreateInfo = vkInit::command_pool_create_info(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		const uint32_t recordJobCount = workerThreads.getThreadCount() + 1;
+		frames[i].recordPools.resize(recordJobCount);
+		frames[i].recordCommandBuffers.resize(recordJobCount);
+		for (uint32_t job = 0; job < recordJobCount; job++) {
+			VK_CHECK(vkCreateCommandPool(device, &recordPoolCreateInfo, nullptr, &frames[i].recordPools[job]));
+
+			VkCommandBufferAllocateInfo recordAllocInfo = vkInit::command_buffer_allocate_info(frames[i].recordPools[job], 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			VK_CHECK(vkAllocateCommandBuffers(device, &recordAllocInfo, &frames[i].recordCommandBuffers[job]));
+		}
+
+		VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &frames[i].staticPool));
+		VkCommandBufferAllocateInfo staticAllocInfo = vkInit::command_buffer_allocate_info(frames[i].staticPool, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		VK_CHECK(vkAllocateCommandBuffers(device, &staticAllocInfo, &frames[i].staticCommandBuffer));
 	}
 
 	VK_CHECK(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &immCommandPool));
@@ -608,7 +732,8 @@ void VulkanEngine::initDescriptors()
 	//create a descriptor pool that will hold 10 sets with 1 image each
 	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes =
 	{
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 }
 	};
 
 	globalDescriptorAllocator.init(device, 10, sizes);
@@ -633,11 +758,34 @@ void VulkanEngine::initDescriptors()
 
 	{
 		DescriptorLayoutBuilder builder;
-		builder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
 		gpuSceneDataDescriptorLayout = builder.build(device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 
+	//scene data ring, one slot per frame in flight. Each slot has to start at a multiple of
+	//minUniformBufferOffsetAlignment so it can be selected with a dynamic offset
+	{
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(chosenGPU, &properties);
+		const size_t alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+		sceneDataStride = sizeof(GPUSceneData);
+		if (alignment > 0) {
+			sceneDataStride = (sceneDataStride + alignment - 1) & ~(alignment - 1);
+		}
+
+		sceneDataRing = createBuffer(sceneDataStride * FRAME_OVERLAP, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+		//the descriptor always points at slot 0, the frame slot is picked at bind time
+		sceneDataDescriptors = globalDescriptorAllocator.allocate(device, gpuSceneDataDescriptorLayout);
+
+		DescriptorWriter sceneWriter{};
+		sceneWriter.writeBuffer(0, sceneDataRing.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+		sceneWriter.updateSet(device, sceneDataDescriptors);
+	}
+
 	mainDeletionQueue.pushFunction([&]() {
+		destroyBuffer(sceneDataRing);
 		globalDescriptorAllocator.destroyPools(device);
 
 		vkDestroyDescriptorSetLayout(device, drawImageDescriptorLayout, nullptr);
@@ -667,6 +815,8 @@ void VulkanEngine::initDescriptors()
 void VulkanEngine::initPipelines()
 {
 	initBackgroundPipelines();
+	initCullPipeline();
+	initTransformPipelines();
 	initMeshPipeline();
 
 	metalRoughMaterial.buildPipelines(this);
@@ -757,6 +907,120 @@ void VulkanEngine::initBackgroundPipelines()
 		});
 }
 
+void VulkanEngine::initCullPipeline()
+{
+	VkPipelineLayoutCreateInfo computeLayout{};
+	computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	computeLayout.pNext = nullptr;
+	//every buffer is accessed through its device address, no descriptor sets needed
+	computeLayout.pSetLayouts = nullptr;
+	computeLayout.setLayoutCount = 0;
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(GPUCullPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	computeLayout.pPushConstantRanges = &pushConstant;
+	computeLayout.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(device, &computeLayout, nullptr, &cullPipelineLayout));
+
+	std::string shadersRootPath{ "../ShaderCompiler" };
+
+	#ifdef SHADERS_PATH
+		shadersRootPath = SHADERS_PATH;
+	#endif
+	auto cullComp = shadersRootPath + "/cull.comp.spv";
+	VkShaderModule cullShader;
+	if (!vkUtil::loadShaderModule(cullComp, device, cullShader))
+	{
+		fmt::print("Error when building the culling compute shader \n");
+	}
+
+	VkPipelineShaderStageCreateInfo stageinfo{};
+	stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageinfo.pNext = nullptr;
+	stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageinfo.module = cullShader;
+	stageinfo.pName = "main";
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.pNext = nullptr;
+	computePipelineCreateInfo.layout = cullPipelineLayout;
+	computePipelineCreateInfo.stage = stageinfo;
+
+	VK_CHECK(vkCreateComputePipelines(device,VK_NULL_HANDLE,1,&computePipelineCreateInfo, nullptr, &cullPipeline));
+
+	vkDestroyShaderModule(device, cullShader, nullptr);
+
+	mainDeletionQueue.pushFunction([=,this]() {
+		vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+		});
+}
+
+void VulkanEngine::initTransformPipelines()
+{
+	VkPipelineLayoutCreateInfo computeLayout{};
+	computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	computeLayout.pNext = nullptr;
+	//both passes only use buffer device addresses, and share the push constant layout
+	computeLayout.pSetLayouts = nullptr;
+	computeLayout.setLayoutCount = 0;
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(GPUTransformPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	computeLayout.pPushConstantRanges = &pushConstant;
+	computeLayout.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(device, &computeLayout, nullptr, &transformPipelineLayout));
+
+	std::string shadersRootPath{ "../ShaderCompiler" };
+
+	#ifdef SHADERS_PATH
+		shadersRootPath = SHADERS_PATH;
+	#endif
+
+	auto buildPipeline = [&](const std::string& shaderFile, VkPipeline& pipeline) {
+		VkShaderModule shader;
+		if (!vkUtil::loadShaderModule(shadersRootPath + shaderFile, device, shader))
+		{
+			fmt::print("Error when building the transform compute shader {} \n", shaderFile);
+		}
+
+		VkPipelineShaderStageCreateInfo stageinfo{};
+		stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stageinfo.pNext = nullptr;
+		stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		stageinfo.module = shader;
+		stageinfo.pName = "main";
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo{};
+		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCreateInfo.pNext = nullptr;
+		computePipelineCreateInfo.layout = transformPipelineLayout;
+		computePipelineCreateInfo.stage = stageinfo;
+
+		VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+
+		vkDestroyShaderModule(device, shader, nullptr);
+	};
+
+	buildPipeline("/transforms.comp.spv", transformLevelPipeline);
+	buildPipeline("/transform_scatter.comp.spv", transformScatterPipeline);
+
+	mainDeletionQueue.pushFunction([=,this]() {
+		vkDestroyPipelineLayout(device, transformPipelineLayout, nullptr);
+		vkDestroyPipeline(device, transformLevelPipeline, nullptr);
+		vkDestroyPipeline(device, transformScatterPipeline, nullptr);
+		});
+}
+
 void VulkanEngine::initImgui()
 {
 // 1: create descriptor pool for IMGUI
@@ -861,6 +1125,314 @@ void VulkanEngine::drawImgui(VkCommandBuffer cmd, VkImageView targetImageView)
 	
 }
 
+void VulkanEngine::prepareGeometry(VkCommandBuffer cmd)
+{
+	//begin clock
+	auto start = std::chrono::system_clock::now();
+
+	// distance of the object origin along the camera forward axis
+	auto viewDepth = [&](const RenderObject& r) {
+		return -(sceneData.view * r.transform[3]).z;
+	};
+
+	// opaque surfaces are sorted by pipeline, material and mesh, then front to back
+	opaqueDrawKeys.clear();
+	opaqueDrawKeys.reserve(mainDrawContext.OpaqueSurfaces.size());
+	for (uint32_t i = 0; i < mainDrawContext.OpaqueSurfaces.size(); i++) {
+		const RenderObject& r = mainDrawContext.OpaqueSurfaces[i];
+		uint16_t depth = vkDraw::quantizeDepth(viewDepth(r), kDrawSortDepthRange);
+		opaqueDrawKeys.push_back({ vkDraw::makeOpaqueKey(r.material->pipeline->sortId, r.material->sortId, r.meshId, r.surfaceIndex, depth), i });
+	}
+	vkDraw::radixSort(opaqueDrawKeys, drawKeyScratch);
+
+	// transparent surfaces are sorted back to front
+	transparentDrawKeys.clear();
+	transparentDrawKeys.reserve(mainDrawContext.TransparentSurfaces.size());
+	for (uint32_t i = 0; i < mainDrawContext.TransparentSurfaces.size(); i++) {
+		const RenderObject& r = mainDrawContext.TransparentSurfaces[i];
+		uint16_t depth = vkDraw::quantizeDepth(viewDepth(r), kDrawSortDepthRange);
+		transparentDrawKeys.push_back({ vkDraw::makeTransparentKey(r.material->pipeline->sortId, r.material->sortId, r.meshId, r.surfaceIndex, depth), i });
+	}
+	vkDraw::radixSort(transparentDrawKeys, drawKeyScratch);
+
+	//write the scene data into this frame's slot of the ring. The render fence of this frame
+	//was already waited on, so the gpu is done reading the slot
+	const uint32_t sceneDataOffset = static_cast<uint32_t>((frameNumber % FRAME_OVERLAP) * sceneDataStride);
+	memcpy((char*)sceneDataRing.info.pMappedData + sceneDataOffset, &sceneData, sizeof(GPUSceneData));
+	vmaFlushAllocation(allocator, sceneDataRing.allocation, sceneDataOffset, sizeof(GPUSceneData));
+
+	//write the transforms of all draws in sorted order, so every run of identical surfaces
+	//owns a contiguous range of the instance buffer
+	FrameData& frame = getCurrentFrame();
+	reserveFrameBuffer(frame.instanceBuffer, frame.instanceCapacity, opaqueDrawKeys.size() + transparentDrawKeys.size(), sizeof(GPUInstanceData),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+	//draws with a gpu computed world matrix get their slot filled by the scatter pass instead
+	GPUInstanceData* instanceData = (GPUInstanceData*)frame.instanceBuffer.info.pMappedData;
+	uint32_t instanceCount = 0;
+	transformScatters.clear();
+	auto writeInstance = [&](const RenderObject& r) {
+		GPUInstanceData& instance = instanceData[instanceCount];
+		if (r.transformAddress != 0) {
+			transformScatters.push_back({ r.transformAddress, instanceCount, 0 });
+		}
+		else {
+			instance.worldMatrix = r.transform;
+		}
+		instance.vertexBuffer = r.vertexBufferAddress;
+		instance.materialIndex = r.material->materialIndex;
+		instanceCount++;
+	};
+	for (const DrawKey& k : opaqueDrawKeys) {
+		writeInstance(mainDrawContext.OpaqueSurfaces[k.index]);
+	}
+	for (const DrawKey& k : transparentDrawKeys) {
+		writeInstance(mainDrawContext.TransparentSurfaces[k.index]);
+	}
+	vmaFlushAllocation(allocator, frame.instanceBuffer.allocation, 0, instanceCount * sizeof(GPUInstanceData));
+
+	if (useGpuTransforms) {
+		propagateTransforms(cmd);
+	}
+
+	if (useGpuDrivenRendering) {
+		cullGeometry(cmd);
+	}
+
+	auto end = std::chrono::system_clock::now();
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+	stats.mesh_draw_time = elapsed.count() / 1000.f;
+}
+
+void VulkanEngine::cullGeometry(VkCommandBuffer cmd)
+{
+	FrameData& frame = getCurrentFrame();
+
+	// split the sorted opaque draws into batches that can share one indirect count draw.
+	// the vertex buffer comes from the instance data and meshes share the arena index buffer,
+	// so a batch spans every mesh drawn with the same material. in bindless mode the material is read
+	// per instance as well and a batch spans every material of a pipeline, the keys are sorted by pipeline first
+	auto sameBatch = [&](const MaterialInstance* a, const MaterialInstance* b) {
+		if (useBindlessMaterials) {
+			return metalRoughMaterial.getBindlessPipeline(a->passType) == metalRoughMaterial.getBindlessPipeline(b->passType);
+		}
+		return a == b;
+	};
+	gpuDrivenBatches.clear();
+	for (uint32_t i = 0; i < opaqueDrawKeys.size(); i++) {
+		const RenderObject& r = mainDrawContext.OpaqueSurfaces[opaqueDrawKeys[i].index];
+		if (gpuDrivenBatches.empty() || !sameBatch(gpuDrivenBatches.back().material, r.material)
+			|| gpuDrivenBatches.back().indexBuffer != r.indexBuffer) {
+			gpuDrivenBatches.push_back({ r.material, r.indexBuffer, i, 0 });
+		}
+		gpuDrivenBatches.back().maxDrawCount++;
+	}
+
+	const size_t objectCount = opaqueDrawKeys.size();
+	if (objectCount == 0) {
+		return;
+	}
+
+	reserveFrameBuffer(frame.objectBuffer, frame.objectCapacity, objectCount, sizeof(GPUObjectData),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	reserveFrameBuffer(frame.drawCommandBuffer, frame.drawCommandCapacity, objectCount, sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	reserveFrameBuffer(frame.drawCountBuffer, frame.drawCountCapacity, gpuDrivenBatches.size(), sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	// upload all object records in one pass, object i uses instance i
+	GPUObjectData* objects = (GPUObjectData*)frame.objectBuffer.info.pMappedData;
+	for (uint32_t batchIndex = 0; batchIndex < gpuDrivenBatches.size(); batchIndex++) {
+		const GPUDrivenBatch& batch = gpuDrivenBatches[batchIndex];
+		for (uint32_t i = batch.commandOffset; i < batch.commandOffset + batch.maxDrawCount; i++) {
+			const RenderObject& r = mainDrawContext.OpaqueSurfaces[opaqueDrawKeys[i].index];
+			GPUObjectData& object = objects[i];
+			object.sphere = vkCull::transformSphere(r.transform, r.bounds.origin, r.bounds.sphereRadius);
+			object.indexCount = r.indexCount;
+			object.firstIndex = r.firstIndex;
+			object.batchIndex = batchIndex;
+			object.commandOffset = batch.commandOffset;
+		}
+	}
+	vmaFlushAllocation(allocator, frame.objectBuffer.allocation, 0, objectCount * sizeof(GPUObjectData));
+
+	// reset the draw counts before the culling pass appends to them
+	vkCmdFillBuffer(cmd, frame.drawCountBuffer.buffer, 0, gpuDrivenBatches.size() * sizeof(uint32_t), 0);
+
+	VkMemoryBarrier2 clearBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	clearBarrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+	clearBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	clearBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	VkDependencyInfo clearDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	clearDependency.memoryBarrierCount = 1;
+	clearDependency.pMemoryBarriers = &clearBarrier;
+	vkCmdPipelineBarrier2(cmd, &clearDependency);
+
+	GPUCullPushConstants pushConstants{};
+	Frustum frustum = vkCull::extractFrustum(sceneData.viewproj);
+	for (int i = 0; i < 6; i++) {
+		pushConstants.frustumPlanes[i] = frustum.planes[i];
+	}
+	pushConstants.objectBuffer = getBufferAddress(frame.objectBuffer);
+	pushConstants.drawCommandBuffer = getBufferAddress(frame.drawCommandBuffer);
+	pushConstants.drawCountBuffer = getBufferAddress(frame.drawCountBuffer);
+	pushConstants.objectCount = static_cast<uint32_t>(objectCount);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants), &pushConstants);
+	// 64 objects per workgroup
+	vkCmdDispatch(cmd, static_cast<uint32_t>((objectCount + 63) / 64), 1, 1);
+
+	// the indirect commands and counts are read by the draws
+	VkMemoryBarrier2 cullBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	cullBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	cullBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	cullBarrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+
+	VkDependencyInfo cullDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	cullDependency.memoryBarrierCount = 1;
+	cullDependency.pMemoryBarriers = &cullBarrier;
+	vkCmdPipelineBarrier2(cmd, &cullDependency);
+}
+
+void VulkanEngine::propagateTransforms(VkCommandBuffer cmd)
+{
+	FrameData& frame = getCurrentFrame();
+	const uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+
+	VkMemoryBarrier2 levelBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	levelBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	levelBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	levelBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	VkDependencyInfo levelDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	levelDependency.memoryBarrierCount = 1;
+	levelDependency.pMemoryBarriers = &levelBarrier;
+
+	bool pipelineBound = false;
+	for (auto& [name, scene] : loadedScenes) {
+		SceneHierarchy& hierarchy = scene->hierarchy;
+		const size_t nodeCount = hierarchy.size();
+		if (nodeCount == 0) {
+			continue;
+		}
+
+		if (scene->gpuWorldBuffer.buffer == VK_NULL_HANDLE) {
+			scene->gpuNodeBuffer = createBuffer(FRAME_OVERLAP * nodeCount * sizeof(GPUTransformNode),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+			scene->gpuWorldBuffer = createBuffer(nodeCount * sizeof(glm::mat4),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+			scene->gpuWorldAddress = getBufferAddress(scene->gpuWorldBuffer);
+			scene->gpuPendingNodes.assign(FRAME_OVERLAP, {});
+			scene->gpuNodeRewrite.assign(FRAME_OVERLAP, 1);
+			scene->gpuDirtyLevel = 0;
+		}
+
+		// static scenes keep the world matrices of the last propagation, a new top matrix changes all of them
+		const uint32_t levelCount = static_cast<uint32_t>(hierarchy.levelOffsets.size());
+		if (scene->gpuWorldTopMatrix != scene->drawTopMatrix) {
+			scene->gpuDirtyLevel = 0;
+		}
+		if (scene->gpuDirtyLevel >= levelCount) {
+			continue;
+		}
+
+		// this frame's copy of the nodes only gets the nodes changed since it was last written,
+		// the other copy may still be read by the previous frame
+		const size_t nodeOffset = frameIndex * nodeCount * sizeof(GPUTransformNode);
+		GPUTransformNode* nodes = (GPUTransformNode*)((char*)scene->gpuNodeBuffer.info.pMappedData + nodeOffset);
+		auto writeNode = [&](uint32_t i) {
+			const Transformation& local = hierarchy.localTransforms[i];
+			const glm::quat& rotation = local.getRotationR();
+			nodes[i].translation = glm::vec4(local.getPositionR(), 0.f);
+			nodes[i].rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+			nodes[i].scale = glm::vec4(local.getScaleR(), 0.f);
+			nodes[i].parent = hierarchy.parents[i];
+		};
+		std::vector<uint32_t>& pending = scene->gpuPendingNodes[frameIndex];
+		if (scene->gpuNodeRewrite[frameIndex]) {
+			for (uint32_t i = 0; i < nodeCount; i++) {
+				writeNode(i);
+			}
+			vmaFlushAllocation(allocator, scene->gpuNodeBuffer.allocation, nodeOffset, nodeCount * sizeof(GPUTransformNode));
+			scene->gpuNodeRewrite[frameIndex] = 0;
+		}
+		else if (!pending.empty()) {
+			std::sort(pending.begin(), pending.end());
+			pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+			for (uint32_t i : pending) {
+				writeNode(i);
+			}
+			vmaFlushAllocation(allocator, scene->gpuNodeBuffer.allocation, nodeOffset + pending.front() * sizeof(GPUTransformNode),
+				(pending.back() - pending.front() + 1) * sizeof(GPUTransformNode));
+		}
+		pending.clear();
+
+		if (!pipelineBound) {
+			// the previous frame may still be reading world matrices in its scatter pass
+			vkCmdPipelineBarrier2(cmd, &levelDependency);
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, transformLevelPipeline);
+			pipelineBound = true;
+		}
+
+		GPUTransformPushConstants pushConstants{};
+		pushConstants.topMatrix = scene->drawTopMatrix;
+		pushConstants.inputBuffer = getBufferAddress(scene->gpuNodeBuffer) + nodeOffset;
+		pushConstants.outputBuffer = scene->gpuWorldAddress;
+
+		// every level reads the world matrices its parent level wrote, the levels above the first changed node are current
+		for (size_t level = scene->gpuDirtyLevel; level < levelCount; level++) {
+			const uint32_t first = hierarchy.levelOffsets[level];
+			const uint32_t end = level + 1 < hierarchy.levelOffsets.size() ? hierarchy.levelOffsets[level + 1] : static_cast<uint32_t>(nodeCount);
+			pushConstants.first = first;
+			pushConstants.count = end - first;
+
+			vkCmdPushConstants(cmd, transformPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUTransformPushConstants), &pushConstants);
+			vkCmdDispatch(cmd, (pushConstants.count + 63) / 64, 1, 1);
+			vkCmdPipelineBarrier2(cmd, &levelDependency);
+		}
+
+		scene->gpuDirtyLevel = levelCount;
+		scene->gpuWorldTopMatrix = scene->drawTopMatrix;
+	}
+
+	if (transformScatters.empty()) {
+		return;
+	}
+
+	reserveFrameBuffer(frame.transformScatterBuffer, frame.transformScatterCapacity, transformScatters.size(), sizeof(GPUTransformScatter),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	memcpy(frame.transformScatterBuffer.info.pMappedData, transformScatters.data(), transformScatters.size() * sizeof(GPUTransformScatter));
+	vmaFlushAllocation(allocator, frame.transformScatterBuffer.allocation, 0, transformScatters.size() * sizeof(GPUTransformScatter));
+
+	GPUTransformPushConstants pushConstants{};
+	pushConstants.inputBuffer = getBufferAddress(frame.transformScatterBuffer);
+	pushConstants.outputBuffer = getBufferAddress(frame.instanceBuffer);
+	pushConstants.first = 0;
+	pushConstants.count = static_cast<uint32_t>(transformScatters.size());
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, transformScatterPipeline);
+	vkCmdPushConstants(cmd, transformPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUTransformPushConstants), &pushConstants);
+	vkCmdDispatch(cmd, (pushConstants.count + 63) / 64, 1, 1);
+
+	// the instance slots are read by the vertex shader
+	VkMemoryBarrier2 scatterBarrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	scatterBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	scatterBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	scatterBarrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+	scatterBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+	VkDependencyInfo scatterDependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	scatterDependency.memoryBarrierCount = 1;
+	scatterDependency.pMemoryBarriers = &scatterBarrier;
+	vkCmdPipelineBarrier2(cmd, &scatterDependency);
+}
+
 void VulkanEngine::drawGeometry(VkCommandBuffer cmd)
 {
 	//reset counters
@@ -871,120 +1443,250 @@ void VulkanEngine::drawGeometry(VkCommandBuffer cmd)
 	
 	// draw geometry logic
 	{
+		FrameData& frame = getCurrentFrame();
 
-		std::vector<uint32_t> opaque_draws{};
-		opaque_draws.reserve(mainDrawContext.OpaqueSurfaces.size());
+		// flatten everything that will be recorded into draw items, in submission order
+		drawItems.clear();
 
-		for (uint32_t i = 0; i < mainDrawContext.OpaqueSurfaces.size(); i++) {
-			opaque_draws.push_back(i);
+		if (useGpuDrivenRendering) {
+			// the culling pass wrote the commands of every batch, the cpu cost no longer depends on the object count
+			for (uint32_t batchIndex = 0; batchIndex < gpuDrivenBatches.size(); batchIndex++) {
+				const GPUDrivenBatch& batch = gpuDrivenBatches[batchIndex];
+				drawItems.push_back({ batch.material, batch.indexBuffer, 0, 0, 0, 0, static_cast<int32_t>(batchIndex) });
+			}
 		}
+		else {
+			appendInstancedDraws(drawItems, opaqueDrawKeys, mainDrawContext.OpaqueSurfaces, 0);
+		}
+		// transparent draws stay on the cpu path, the culling pass would lose their back to front order
+		appendInstancedDraws(drawItems, transparentDrawKeys, mainDrawContext.TransparentSurfaces, static_cast<uint32_t>(opaqueDrawKeys.size()));
 
-		// sort the opaque surfaces by material and mesh
-		std::sort(opaque_draws.begin(), opaque_draws.end(), [&](const auto& iA, const auto& iB) {
-			const RenderObject& A = mainDrawContext.OpaqueSurfaces[iA];
-			const RenderObject& B = mainDrawContext.OpaqueSurfaces[iB];
-			if (A.material == B.material) {
-				return A.indexBuffer < B.indexBuffer;
-			}
-			else {
-				return A.material < B.material;
+		const VkDeviceAddress instanceBufferAddress = frame.instanceBuffer.buffer != VK_NULL_HANDLE ? getBufferAddress(frame.instanceBuffer) : 0;
+
+		DrawCounters counters{};
+		if (drawsStaticBundles() && !staticDrawContext.OpaqueSurfaces.empty()) {
+			// replay the static opaque geometry, it is only recorded again when the static set or the viewport changed
+			if (frame.staticGeneration != staticGeneration || frame.staticExtent.width != windowExtent.width
+				|| frame.staticExtent.height != windowExtent.height || frame.staticMaterialTable != metalRoughMaterial.materialTable.getAddress()) {
+				recordStaticBundle(frame);
 			}
+			vkCmdExecuteCommands(cmd, 1, &frame.staticCommandBuffer);
+			counters.drawcalls += frame.staticCounters.drawcalls;
+			counters.triangles += frame.staticCounters.triangles;
+		}
+
+		if (!recordsSecondaries()) {
+			recordDraws(cmd, drawItems.data(), drawItems.size(), instanceBufferAddress, counters);
+		}
+		else {
+			// contiguous chunks keep the sorted order once the secondaries are executed one after another.
+			// small chunks are not worth a command buffer
+			constexpr size_t minItemsPerJob = 64;
+			const size_t jobCount = std::clamp<size_t>(drawItems.size() / minItemsPerJob, 1, frame.recordCommandBuffers.size());
+			const size_t itemsPerJob = (drawItems.size() + jobCount - 1) / jobCount;
+			std::vector<DrawCounters> jobCounters(jobCount);
+
+			VkCommandBufferInheritanceRenderingInfo inheritanceRendering{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+			inheritanceRendering.colorAttachmentCount = 1;
+			inheritanceRendering.pColorAttachmentFormats = &drawImage.imageFormat;
+			inheritanceRendering.depthAttachmentFormat = depthImage.imageFormat;
+			inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+			VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+			inheritance.pNext = &inheritanceRendering;
+
+			workerThreads.parallelFor(static_cast<uint32_t>(jobCount), [&](uint32_t job) {
+				// every job owns its pool, so no two threads ever record from the same one
+				VK_CHECK(vkResetCommandPool(device, frame.recordPools[job], 0));
+
+				VkCommandBuffer secondary = frame.recordCommandBuffers[job];
+				VkCommandBufferBeginInfo beginInfo = vkInit::command_buffer_begin_info(
+					VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+				beginInfo.pInheritanceInfo = &inheritance;
+				VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+				const size_t first = job * itemsPerJob;
+				const size_t count = std::min(itemsPerJob, drawItems.size() - std::min(first, drawItems.size()));
+				recordDraws(secondary, drawItems.data() + first, count, instanceBufferAddress, jobCounters[job]);
+
+				VK_CHECK(vkEndCommandBuffer(secondary));
 			});
 
-		//allocate a new uniform buffer for the scene data
-		AllocatedBuffer gpuSceneDataBuffer = createBuffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+			vkCmdExecuteCommands(cmd, static_cast<uint32_t>(jobCount), frame.recordCommandBuffers.data());
+			for (const DrawCounters& jobCounter : jobCounters) {
+				counters.drawcalls += jobCounter.drawcalls;
+				counters.triangles += jobCounter.triangles;
+			}
+		}
+		stats.drawcall_count = counters.drawcalls;
+		stats.triangle_count = counters.triangles;
 
-		//add it to the deletion queue of this frame so it gets deleted once its been used
-		getCurrentFrame().deletionQueue.pushFunction([=, this]() {
-			destroyBuffer(gpuSceneDataBuffer);
-			});
+		mainDrawContext.OpaqueSurfaces.clear();
+		mainDrawContext.TransparentSurfaces.clear();
+	}
 
-		//write the buffer
-		GPUSceneData* sceneUniformData = (GPUSceneData*)gpuSceneDataBuffer.allocation->GetMappedData();
-		*sceneUniformData = sceneData;
-		//create a descriptor set that binds that buffer and update it
-		VkDescriptorSet globalDescriptor = getCurrentFrame().frameDescriptors.allocate(device, gpuSceneDataDescriptorLayout);
+	auto end = std::chrono::system_clock::now();
 
-		DescriptorWriter writer;
-		writer.writeBuffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		writer.updateSet(device, globalDescriptor);
+    //convert to microseconds (integer), and then come back to miliseconds
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    stats.mesh_draw_time += elapsed.count() / 1000.f;
+}
 
-		MaterialPipeline* lastPipeline = nullptr;
-		MaterialInstance* lastMaterial = nullptr;
-		VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
+void VulkanEngine::appendInstancedDraws(std::vector<DrawItem>& items, const std::vector<DrawKey>& keys, const std::vector<RenderObject>& surfaces, uint32_t instanceBase)
+{
+	//collapse runs of consecutive draws of the same surface with the same material into one instanced draw
+	auto isSameSurface = [](const RenderObject& a, const RenderObject& b) {
+		return a.material == b.material && a.indexBuffer == b.indexBuffer && a.firstIndex == b.firstIndex
+			&& a.indexCount == b.indexCount && a.vertexBufferAddress == b.vertexBufferAddress;
+	};
 
-		auto drawLambda = [&](const RenderObject& draw){
-			
-			if (draw.material != lastMaterial) {
-				lastMaterial = draw.material;
-
-				if (draw.material->pipeline != lastPipeline) {
-					lastPipeline = draw.material->pipeline;
-					vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.material->pipeline->pipeline);
-					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.material->pipeline->layout, 0, 1,
-						&globalDescriptor, 0, nullptr);
-
-					VkViewport viewport = {};
-					viewport.x = 0;
-					viewport.y = 0;
-					viewport.width = (float)windowExtent.width;
-					viewport.height = (float)windowExtent.height;
-					viewport.minDepth = 0.f;
-					viewport.maxDepth = 1.f;
-
-					vkCmdSetViewport(cmd, 0, 1, &viewport);
-
-					VkRect2D scissor = {};
-					scissor.offset.x = 0;
-					scissor.offset.y = 0;
-					scissor.extent.width = windowExtent.width;
-					scissor.extent.height = windowExtent.height;
-
-					vkCmdSetScissor(cmd, 0, 1, &scissor);
-				}
+	size_t runStart = 0;
+	while (runStart < keys.size()) {
+		const RenderObject& first = surfaces[keys[runStart].index];
+		size_t runEnd = runStart + 1;
+		while (runEnd < keys.size() && isSameSurface(first, surfaces[keys[runEnd].index])) {
+			runEnd++;
+		}
+		items.push_back({ first.material, first.indexBuffer, first.indexCount, first.firstIndex,
+			static_cast<uint32_t>(runEnd - runStart), instanceBase + static_cast<uint32_t>(runStart), -1 });
+		runStart = runEnd;
+	}
+}
 
-				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.material->pipeline->layout, 1, 1,
-					&draw.material->materialSet, 0, nullptr);
-			}
-			if (draw.indexBuffer != lastIndexBuffer) {
-				lastIndexBuffer = draw.indexBuffer;
-				vkCmdBindIndexBuffer(cmd, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-			}
-			
+void VulkanEngine::recordStaticBundle(FrameData& frame)
+{
+	// same ordering as the dynamic opaque draws, depth does not matter for a list that is drawn from every view
+	const std::vector<RenderObject>& surfaces = staticDrawContext.OpaqueSurfaces;
+	std::vector<DrawKey> keys;
+	keys.reserve(surfaces.size());
+	for (uint32_t i = 0; i < surfaces.size(); i++) {
+		const RenderObject& r = surfaces[i];
+		keys.push_back({ vkDraw::makeOpaqueKey(r.material->pipeline->sortId, r.material->sortId, r.meshId, r.surfaceIndex, 0), i });
+	}
+	vkDraw::radixSort(keys, drawKeyScratch);
+
+	// the bundle has its own instance buffer, the per frame one is rewritten in a different order every frame
+	reserveFrameBuffer(frame.staticInstanceBuffer, frame.staticInstanceCapacity, keys.size(), sizeof(GPUInstanceData),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	GPUInstanceData* instanceData = (GPUInstanceData*)frame.staticInstanceBuffer.info.pMappedData;
+	for (size_t i = 0; i < keys.size(); i++) {
+		const RenderObject& r = surfaces[keys[i].index];
+		instanceData[i].worldMatrix = r.transform;
+		instanceData[i].vertexBuffer = r.vertexBufferAddress;
+		instanceData[i].materialIndex = r.material->materialIndex;
+	}
+	vmaFlushAllocation(allocator, frame.staticInstanceBuffer.allocation, 0, keys.size() * sizeof(GPUInstanceData));
 
-			GPUDrawPushConstants pushConstants;
-			pushConstants.vertexBuffer = draw.vertexBufferAddress;
-			pushConstants.worldMatrix = draw.transform;
-			vkCmdPushConstants(cmd,draw.material->pipeline->layout ,VK_SHADER_STAGE_VERTEX_BIT,0, sizeof(GPUDrawPushConstants), &pushConstants);
+	std::vector<DrawItem> items;
+	appendInstancedDraws(items, keys, surfaces, 0);
 
-			vkCmdDrawIndexed(cmd,draw.indexCount,1,draw.firstIndex,0,0);
+	VkCommandBufferInheritanceRenderingInfo inheritanceRendering{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	inheritanceRendering.colorAttachmentCount = 1;
+	inheritanceRendering.pColorAttachmentFormats = &drawImage.imageFormat;
+	inheritanceRendering.depthAttachmentFormat = depthImage.imageFormat;
+	inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-			stats.drawcall_count++;
-        	stats.triangle_count += draw.indexCount / 3; 
-		};
+	VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+	inheritance.pNext = &inheritanceRendering;
 
-		
-		for (auto& r : opaque_draws) {
-			drawLambda(mainDrawContext.OpaqueSurfaces[r]);
+	// the render fence of this frame was waited on, so the previous recording is no longer pending
+	VK_CHECK(vkResetCommandPool(device, frame.staticPool, 0));
+	VkCommandBufferBeginInfo beginInfo = vkInit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+	beginInfo.pInheritanceInfo = &inheritance;
+	VK_CHECK(vkBeginCommandBuffer(frame.staticCommandBuffer, &beginInfo));
+
+	frame.staticCounters = {};
+	recordDraws(frame.staticCommandBuffer, items.data(), items.size(), getBufferAddress(frame.staticInstanceBuffer), frame.staticCounters);
+
+	VK_CHECK(vkEndCommandBuffer(frame.staticCommandBuffer));
+
+	frame.staticGeneration = staticGeneration;
+	frame.staticExtent = windowExtent;
+	frame.staticMaterialTable = metalRoughMaterial.materialTable.getAddress();
+}
+
+void VulkanEngine::recordDraws(VkCommandBuffer cmd, const DrawItem* items, size_t count, VkDeviceAddress instanceBufferAddress, DrawCounters& counters)
+{
+	// called from the worker threads, only reads engine state.
+	// the scene data offset is baked in, static bundles are recorded per frame in flight for that reason
+	FrameData& frame = getCurrentFrame();
+	const uint32_t sceneDataOffset = static_cast<uint32_t>((frameNumber % FRAME_OVERLAP) * sceneDataStride);
+
+	MaterialPipeline* lastPipeline = nullptr;
+	MaterialInstance* lastMaterial = nullptr;
+	VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
+
+	auto bindState = [&](MaterialInstance* material, VkBuffer indexBuffer) {
+
+		if (material != lastMaterial) {
+			lastMaterial = material;
+
+			MaterialPipeline* pipeline = useBindlessMaterials ? metalRoughMaterial.getBindlessPipeline(material->passType) : material->pipeline;
+			if (pipeline != lastPipeline) {
+				lastPipeline = pipeline;
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 0, 1,
+					&sceneDataDescriptors, 1, &sceneDataOffset);
+				if (useBindlessMaterials) {
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 1, 1,
+						&metalRoughMaterial.bindlessSet, 0, nullptr);
+				}
+
+				VkViewport viewport = {};
+				viewport.x = 0;
+				viewport.y = 0;
+				viewport.width = (float)windowExtent.width;
+				viewport.height = (float)windowExtent.height;
+				viewport.minDepth = 0.f;
+				viewport.maxDepth = 1.f;
+
+				vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+				VkRect2D scissor = {};
+				scissor.offset.x = 0;
+				scissor.offset.y = 0;
+				scissor.extent.width = windowExtent.width;
+				scissor.extent.height = windowExtent.height;
+
+				vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+				// the vertex buffer, transform and material of every draw are looked up with gl_InstanceIndex
+				GPUMeshPushConstants pushConstants;
+				pushConstants.instanceBuffer = instanceBufferAddress;
+				pushConstants.materialBuffer = metalRoughMaterial.materialTable.getAddress();
+				vkCmdPushConstants(cmd, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUMeshPushConstants), &pushConstants);
+			}
+
+			// in bindless mode a material change costs nothing, the shaders look the material up per draw
+			if (!useBindlessMaterials) {
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 1, 1,
+					&material->materialSet, 0, nullptr);
+			}
 		}
-	
-		for (const RenderObject& draw : mainDrawContext.TransparentSurfaces) {
-			drawLambda(draw);
+		if (indexBuffer != lastIndexBuffer) {
+			lastIndexBuffer = indexBuffer;
+			vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 		}
-		mainDrawContext.OpaqueSurfaces.clear();
-		mainDrawContext.TransparentSurfaces.clear();
-
-	
-	}
+	};
 
-	auto end = std::chrono::system_clock::now();
+	for (size_t i = 0; i < count; i++) {
+		const DrawItem& item = items[i];
+		bindState(item.material, item.indexBuffer);
 
-    //convert to microseconds (integer), and then come back to miliseconds
-    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-    stats.mesh_draw_time = elapsed.count() / 1000.f;
+		if (item.indirectBatch >= 0) {
+			const GPUDrivenBatch& batch = gpuDrivenBatches[item.indirectBatch];
+			vkCmdDrawIndexedIndirectCount(cmd, frame.drawCommandBuffer.buffer, batch.commandOffset * sizeof(VkDrawIndexedIndirectCommand),
+				frame.drawCountBuffer.buffer, item.indirectBatch * sizeof(uint32_t), batch.maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else {
+			vkCmdDrawIndexed(cmd, item.indexCount, item.instanceCount, item.firstIndex, 0, item.firstInstance);
+			counters.triangles += (item.indexCount / 3) * item.instanceCount;
+		}
+		counters.drawcalls++;
+	}
 }
 
-AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VmaAllocationCreateFlags allocFlags)
 {
 	// allocate buffer
 	VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
@@ -995,7 +1697,7 @@ AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags
 
 	VmaAllocationCreateInfo vmaAllocInfo = {};
 	vmaAllocInfo.usage = memoryUsage;
-	vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | allocFlags;
 	AllocatedBuffer newBuffer;
 
 	// allocate the buffer
@@ -1005,63 +1707,86 @@ AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags
 	return newBuffer;
 }
 
+bool VulkanEngine::isHostVisibleDeviceLocal(const AllocatedBuffer& buffer) const
+{
+	VkMemoryPropertyFlags flags = 0;
+	vmaGetAllocationMemoryProperties(allocator, buffer.allocation, &flags);
+	const VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	return (flags & wanted) == wanted;
+}
+
 void VulkanEngine::destroyBuffer(const AllocatedBuffer& buffer)
 {
     vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
 }
 
-GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
+void VulkanEngine::reserveFrameBuffer(AllocatedBuffer& buffer, size_t& capacity, size_t count, size_t elementSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VmaAllocationCreateFlags allocFlags)
 {
-	const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-	const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+	if (count <= capacity) {
+		return;
+	}
 
-	GPUMeshBuffers newSurface;
+	// only called for buffers of the current frame, its render fence was already waited on
+	// so the old buffer is no longer in use
+	if (buffer.buffer != VK_NULL_HANDLE) {
+		destroyBuffer(buffer);
+	}
 
-	//create vertex buffer
-	newSurface.vertexBuffer = createBuffer(vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+	//grow geometrically so scenes that slowly gain objects dont reallocate every frame
+	size_t newCapacity = std::max<size_t>(1024, capacity);
+	while (newCapacity < count) {
+		newCapacity *= 2;
+	}
+
+	buffer = createBuffer(newCapacity * elementSize, usage, memoryUsage, allocFlags);
+	capacity = newCapacity;
+}
 
-	//find the adress of the vertex buffer
+VkDeviceAddress VulkanEngine::getBufferAddress(const AllocatedBuffer& buffer)
+{
 	VkBufferDeviceAddressInfo deviceAdressInfo{  };
 	deviceAdressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	deviceAdressInfo.buffer = newSurface.vertexBuffer.buffer;
-	newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAdressInfo);
-
-	//create index buffer
-	newSurface.indexBuffer = createBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
-
-	AllocatedBuffer staging = createBuffer(vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-	void* data = staging.allocation->GetMappedData();
+	deviceAdressInfo.buffer = buffer.buffer;
+	return vkGetBufferDeviceAddress(device, &deviceAdressInfo);
+}
 
-	// copy vertex buffer
-	memcpy(data, vertices.data(), vertexBufferSize);
-	// copy index buffer
-	memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
+GPUMeshBuffers VulkanEngine::uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices)
+{
+	// the arena only holds the packed layout, the upload copies the data before the scratch is reused
+	thread_local std::vector<PackedVertex> packed;
+	packed.resize(VertexHeaderSlots + vertices.size());
+	vkVertex::pack(vertices, packed.data(), &workerThreads);
+	return uploadMesh(indices, std::span<const PackedVertex>(packed));
+}
 
-	immediateSubmit([&](VkCommandBuffer cmd) {
-		VkBufferCopy vertexCopy{ };
-		vertexCopy.dstOffset = 0;
-		vertexCopy.srcOffset = 0;
-		vertexCopy.size = vertexBufferSize;
+GPUMeshBuffers VulkanEngine::uploadMesh(std::span<const uint32_t> indices, std::span<const PackedVertex> packedVertices)
+{
+	const size_t vertexBufferSize = packedVertices.size() * sizeof(PackedVertex);
+	const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
 
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+	GPUMeshBuffers newSurface;
 
-		VkBufferCopy indexCopy{ };
-		indexCopy.dstOffset = 0;
-		indexCopy.srcOffset = vertexBufferSize;
-		indexCopy.size = indexBufferSize;
+	//sub allocate the vertices and indices from the geometry arena
+	geometryArena.allocate(static_cast<uint32_t>(packedVertices.size()), static_cast<uint32_t>(indices.size()), newSurface);
+	newSurface.meshId = nextMeshId++;
 
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-	});
+	if (geometryArena.write(newSurface, packedVertices.data(), indices.data())) {
+		return newSurface;
+	}
 
-	destroyBuffer(staging);
+	// the copies run on the transfer queue, the first frame drawing the mesh waits for them on the gpu
+	uploadQueue.uploadBuffer(newSurface.vertexBuffer, newSurface.firstVertex * sizeof(PackedVertex), packedVertices.data(), vertexBufferSize);
+	uploadQueue.uploadBuffer(newSurface.indexBuffer, newSurface.firstIndex * sizeof(uint32_t), indices.data(), indexBufferSize);
 
 	return newSurface;
 
 }
 
+void VulkanEngine::releaseMesh(const GPUMeshBuffers& mesh)
+{
+	geometryArena.release(mesh);
+}
+
 void VulkanEngine::initMeshPipeline()
 {
 	std::string shadersRootPath{ "../ShaderCompiler" };
@@ -1141,13 +1866,18 @@ void VulkanEngine::initDefaultData()
 	#ifdef ASSETS_PATH
 	assetRootPath = ASSETS_PATH;
 	#endif
+	// 512k vertices and 2M indices per block, 32MB of memory
+	geometryArena.init(this, 512 * 1024, 2 * 1024 * 1024);
+	mainDeletionQueue.pushFunction([=, this]() {
+		geometryArena.destroy();
+	});
+
 	auto basicMeshPath =  assetRootPath  + "/basicmesh.glb";
 	testMeshes = loadMesh(this, basicMeshPath).value();
 
 	for(auto& meshes : testMeshes ){
 		mainDeletionQueue.pushFunction([&](){
-			destroyBuffer(meshes->meshBuffers.indexBuffer);
-			destroyBuffer(meshes->meshBuffers.vertexBuffer);
+			releaseMesh(meshes->meshBuffers);
 			
 
 		});	
@@ -1207,20 +1937,10 @@ void VulkanEngine::initDefaultData()
 	materialResources.metalRoughImage = whiteImage;
 	materialResources.metalRoughSampler = defaultSamplerLinear;
 
-	//set the uniform buffer for the material data
-	AllocatedBuffer materialConstants = createBuffer(sizeof(GLTFMetallic_Roughness::MaterialConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-	//write the buffer
-	GLTFMetallic_Roughness::MaterialConstants* sceneUniformData = (GLTFMetallic_Roughness::MaterialConstants*)materialConstants.allocation->GetMappedData();
-	sceneUniformData->colorFactors = glm::vec4{1,1,1,1};
-	sceneUniformData->metalRoughFactors = glm::vec4{1,0.5,0,0};
-
-	mainDeletionQueue.pushFunction([=, this]() {
-		destroyBuffer(materialConstants);
-	});
-
-	materialResources.dataBuffer = materialConstants.buffer;
-	materialResources.dataBufferOffset = 0;
+	//set the material parameters
+	materialResources.colorFactors = glm::vec4{1,1,1,1};
+	materialResources.metalRoughFactors = glm::vec4{1,0.5,0,0};
+	materialResources.materialIndex = metalRoughMaterial.materialTable.allocate(1);
 
 	defaultData = metalRoughMaterial.writeMaterial(device,MaterialPass::MainColor,materialResources, globalDescriptorAllocator);
 
@@ -1294,35 +2014,10 @@ AllocatedImage VulkanEngine::createImage(VkExtent3D size, VkFormat format, VkIma
 AllocatedImage VulkanEngine::createImage(void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
 {
 	size_t data_size = size.depth * size.width * size.height * 4;
-	AllocatedBuffer uploadbuffer = createBuffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-	memcpy(uploadbuffer.info.pMappedData, data, data_size);
-
 	AllocatedImage newImage = createImage(size, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mipmapped);
 
-	immediateSubmit([&](VkCommandBuffer cmd) {
-		vkUtil::transition_image(cmd, newImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-		VkBufferImageCopy copyRegion = {};
-		copyRegion.bufferOffset = 0;
-		copyRegion.bufferRowLength = 0;
-		copyRegion.bufferImageHeight = 0;
-
-		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.imageSubresource.mipLevel = 0;
-		copyRegion.imageSubresource.baseArrayLayer = 0;
-		copyRegion.imageSubresource.layerCount = 1;
-		copyRegion.imageExtent = size;
-
-		// copy the buffer into the image
-		vkCmdCopyBufferToImage(cmd, uploadbuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-			&copyRegion);
-
-		vkUtil::transition_image(cmd, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		});
-
-	destroyBuffer(uploadbuffer);
+	// copied on the transfer queue and left in shader read only layout
+	uploadQueue.uploadImage(newImage, data, data_size);
 
 	return newImage;
 }
@@ -1337,6 +2032,11 @@ void VulkanEngine::destroyImage(const AllocatedImage& img)
 
 void GLTFMetallic_Roughness::buildPipelines(VulkanEngine* engine)
 {
+	// shared by every material, grows when files with many materials are loaded
+	materialTable.init(engine, 256);
+	engine->mainDeletionQueue.pushFunction([=, this]() {
+		materialTable.destroy();
+	});
 
 	std::string shadersRootPath{"../ShaderCompiler"};
 
@@ -1357,11 +2057,11 @@ void GLTFMetallic_Roughness::buildPipelines(VulkanEngine* engine)
 
 	VkPushConstantRange matrixRange{};
 	matrixRange.offset = 0;
-	matrixRange.size = sizeof(GPUDrawPushConstants);
+	matrixRange.size = sizeof(GPUMeshPushConstants);
 	matrixRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+    // the material parameters come from the material table, the set only holds the textures
     DescriptorLayoutBuilder layoutBuilder;
-    layoutBuilder.addBinding(0,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
     layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	layoutBuilder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
@@ -1382,6 +2082,9 @@ void GLTFMetallic_Roughness::buildPipelines(VulkanEngine* engine)
     opaquePipeline.layout = newLayout;
     transparentPipeline.layout = newLayout;
 
+	opaquePipeline.sortId = 0;
+	transparentPipeline.sortId = 1;
+
 	// build the stage-create-info for both vertex and fragment stages. This lets
 	// the pipeline know the shader modules per stage
 	std::string entryPoint = "main";
@@ -1413,13 +2116,148 @@ void GLTFMetallic_Roughness::buildPipelines(VulkanEngine* engine)
 	
 	vkDestroyShaderModule(engine->device, meshFragShader, nullptr);
 	vkDestroyShaderModule(engine->device, meshVertexShader, nullptr);
-	
+
+	// bindless variants, same fixed function state with the global material set in place of the per material one
+	initBindless(engine);
+
+	auto bindlessFrag = shadersRootPath + "/mesh_bindless.frag.spv";
+	VkShaderModule bindlessFragShader;
+	if (!vkUtil::loadShaderModule(bindlessFrag, engine->device, bindlessFragShader)) {
+		fmt::println("Error when building the bindless fragment shader module");
+	}
+	auto bindlessVert = shadersRootPath + "/mesh_bindless.vert.spv";
+	VkShaderModule bindlessVertexShader;
+	if (!vkUtil::loadShaderModule(bindlessVert, engine->device, bindlessVertexShader)) {
+		fmt::println("Error when building the bindless vertex shader module");
+	}
+
+	VkDescriptorSetLayout bindlessLayouts[] = { engine->gpuSceneDataDescriptorLayout,
+		bindlessLayout };
+	meshLayoutInfo.pSetLayouts = bindlessLayouts;
+
+	VkPipelineLayout bindlessPipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(engine->device, &meshLayoutInfo, nullptr, &bindlessPipelineLayout));
+
+	bindlessOpaquePipeline.layout = bindlessPipelineLayout;
+	bindlessTransparentPipeline.layout = bindlessPipelineLayout;
+	bindlessOpaquePipeline.sortId = opaquePipeline.sortId;
+	bindlessTransparentPipeline.sortId = transparentPipeline.sortId;
+
+	pipelineBuilder.setShaders(bindlessVertexShader, entryPoint, bindlessFragShader, entryPoint);
+	pipelineBuilder.pipelineLayout = bindlessPipelineLayout;
+	pipelineBuilder.disableBlending();
+	pipelineBuilder.enableDepthTest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	bindlessOpaquePipeline.pipeline = pipelineBuilder.buildPipeline(engine->device);
+
+	pipelineBuilder.enableBlendingAdditive();
+	pipelineBuilder.enableDepthTest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	bindlessTransparentPipeline.pipeline = pipelineBuilder.buildPipeline(engine->device);
+
+	vkDestroyShaderModule(engine->device, bindlessFragShader, nullptr);
+	vkDestroyShaderModule(engine->device, bindlessVertexShader, nullptr);
+}
+
+void GLTFMetallic_Roughness::initBindless(VulkanEngine* engine)
+{
+	DescriptorLayoutBuilder layoutBuilder;
+	layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxBindlessTextures);
+
+	// textures are added while earlier frames using the set are still in flight
+	VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+	bindingFlagsInfo.bindingCount = 1;
+	bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+	bindlessLayout = layoutBuilder.build(engine->device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		&bindingFlagsInfo, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+	VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxBindlessTextures };
+	VkDescriptorPoolCreateInfo poolInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	VK_CHECK(vkCreateDescriptorPool(engine->device, &poolInfo, nullptr, &bindlessPool));
+
+	VkDescriptorSetAllocateInfo allocInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.descriptorPool = bindlessPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &bindlessLayout;
+	VK_CHECK(vkAllocateDescriptorSets(engine->device, &allocInfo, &bindlessSet));
+}
+
+uint32_t GLTFMetallic_Roughness::registerTexture(VkDevice device, VkImageView image, VkSampler sampler)
+{
+	auto it = bindlessTextureSlots.find({ image, sampler });
+	if (it != bindlessTextureSlots.end()) {
+		bindlessSlotUsers[it->second]++;
+		return it->second;
+	}
+
+	uint32_t slot;
+	if (!freeTextureSlots.empty()) {
+		slot = freeTextureSlots.back();
+		freeTextureSlots.pop_back();
+	}
+	else if (nextTextureSlot < maxBindlessTextures) {
+		slot = nextTextureSlot++;
+		bindlessSlotKeys.resize(nextTextureSlot);
+		bindlessSlotUsers.resize(nextTextureSlot, 0);
+	}
+	else {
+		// slot 0 is the white default texture, it is never given back
+		fmt::println("bindless texture array is full");
+		return 0;
+	}
+	VkDescriptorImageInfo imageInfo{ sampler, image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet write{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write.dstSet = bindlessSet;
+	write.dstBinding = 0;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+	bindlessTextureSlots[{ image, sampler }] = slot;
+	bindlessSlotKeys[slot] = { image, sampler };
+	bindlessSlotUsers[slot] = 1;
+	return slot;
+}
+
+void GLTFMetallic_Roughness::unregisterTexture(uint32_t slot)
+{
+	// the descriptor is left as it is, partially bound slots that are not indexed are never read
+	if (slot >= bindlessSlotUsers.size() || bindlessSlotUsers[slot] == 0 || --bindlessSlotUsers[slot] > 0) {
+		return;
+	}
+	bindlessTextureSlots.erase(bindlessSlotKeys[slot]);
+	bindlessSlotKeys[slot] = {};
+	freeTextureSlots.push_back(slot);
+}
+
+void GLTFMetallic_Roughness::releaseMaterials(uint32_t first, uint32_t count)
+{
+	// the slots of every material are still in the cpu copy of the table
+	for (uint32_t index = first; index < first + count; index++) {
+		const GPUMaterialData& entry = materialTable.getEntry(index);
+		unregisterTexture(entry.colorTexture);
+		unregisterTexture(entry.metalRoughTexture);
+	}
+	materialTable.release(first, count);
+}
+
+MaterialPipeline* GLTFMetallic_Roughness::getBindlessPipeline(MaterialPass pass)
+{
+	return pass == MaterialPass::Transparent ? &bindlessTransparentPipeline : &bindlessOpaquePipeline;
 }
 
 MaterialInstance GLTFMetallic_Roughness::writeMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator)
 {
 	MaterialInstance matData;
 	matData.passType = pass;
+	matData.sortId = nextMaterialId++;
+	matData.materialIndex = resources.materialIndex;
 	if (pass == MaterialPass::Transparent) {
 		matData.pipeline = &transparentPipeline;
 	}
@@ -1431,17 +2269,29 @@ MaterialInstance GLTFMetallic_Roughness::writeMaterial(VkDevice device, Material
 
 
 	writer.clear();
-	writer.writeBuffer(0, resources.dataBuffer, sizeof(MaterialConstants), resources.dataBufferOffset, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 	writer.writeImage(1, resources.colorImage.imageView, resources.colorSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	writer.writeImage(2, resources.metalRoughImage.imageView, resources.metalRoughSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
 	writer.updateSet(device, matData.materialSet);
 
+	// the texture slots are filled for every material so the bindless mode can be switched at runtime
+	GPUMaterialData entry{};
+	entry.colorFactors = resources.colorFactors;
+	entry.metalRoughFactors = resources.metalRoughFactors;
+	entry.colorTexture = registerTexture(device, resources.colorImage.imageView, resources.colorSampler);
+	entry.metalRoughTexture = registerTexture(device, resources.metalRoughImage.imageView, resources.metalRoughSampler);
+	materialTable.write(resources.materialIndex, entry);
+
 	return matData;
 }
 void GLTFMetallic_Roughness::clearResources(VkDevice device){
 	vkDestroyDescriptorSetLayout(device,materialLayout,nullptr);
 	vkDestroyPipelineLayout(device,transparentPipeline.layout,nullptr);
+	vkDestroyDescriptorSetLayout(device, bindlessLayout, nullptr);
+	vkDestroyDescriptorPool(device, bindlessPool, nullptr);
+	vkDestroyPipelineLayout(device, bindlessTransparentPipeline.layout, nullptr);
+	vkDestroyPipeline(device, bindlessTransparentPipeline.pipeline, nullptr);
+	vkDestroyPipeline(device, bindlessOpaquePipeline.pipeline, nullptr);
 
 	vkDestroyPipeline(device, transparentPipeline.pipeline, nullptr);
 	vkDestroyPipeline(device, opaquePipeline.pipeline, nullptr);
@@ -1457,7 +2307,6 @@ void VulkanEngine::updateScene()
 		mainDrawContext.TransparentSurfaces.clear();
 		//camera.getTransformationRW().getPositionRW() = glm::vec3(0.0f,0.0f,5.0f);
 		camera.setPerspectiveProjection(glm::radians(60.f),(float)drawExtent.width / (float)drawExtent.height,1000.0f,0.01f);
-		loadedNodes["Suzanne"]->Draw(glm::mat4{1.f}, mainDrawContext);	
 
 		sceneData.view = camera.getViewMatrix();
 		// camera projection
@@ -1465,6 +2314,13 @@ void VulkanEngine::updateScene()
 
 		sceneData.viewproj = sceneData.proj * sceneData.view;
 
+		// the frustum is needed before the scenes are drawn, they reject whole subtrees of their bvh with it
+		cameraFrustum = vkCull::extractFrustum(sceneData.viewproj);
+		mainDrawContext.frustum = useFrustumCulling ? &cameraFrustum : nullptr;
+		mainDrawContext.gpuTransforms = useGpuTransforms;
+
+		loadedNodes["Suzanne"]->Draw(glm::mat4{1.f}, mainDrawContext);	
+
 		//some default lighting parameters
 		sceneData.ambientColor = glm::vec4(.1f);
 		sceneData.sunlightColor = glm::vec4(1.f);
@@ -1477,8 +2333,23 @@ void VulkanEngine::updateScene()
 
 			loadedNodes["Cube"]->Draw(translation * scale, mainDrawContext);
 		}
-		loadedScenes["cube"]->Draw(glm::mat4{ 1.f }, mainDrawContext);
-		loadedScenes["structure"]->Draw(glm::mat4{ 1.f }, mainDrawContext);
+		for (auto& [name, scene] : loadedScenes) {
+			scene->refreshTransforms(useGpuTransforms);
+		}
+		for (auto& [name, scene] : loadedScenes) {
+			if (drawsStaticBundles() && scene->isStatic) {
+				continue;
+			}
+			scene->Draw(glm::mat4{ 1.f }, mainDrawContext);
+		}
+		if (drawsStaticBundles()) {
+			updateStaticSet();
+		}
+
+		stats.culled_count = 0;
+		if (useFrustumCulling) {
+			cullDrawContext();
+		}
 	}
 	
 	auto end = std::chrono::system_clock::now();
@@ -1489,27 +2360,124 @@ void VulkanEngine::updateScene()
 }
 
 
-void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx)
+void VulkanEngine::updateStaticSet()
 {
-	glm::mat4 nodeMatrix = topMatrix * worldTransform;
+	// keyed on the scene id, a new scene can be allocated where a freed one was
+	std::vector<std::pair<uint64_t, uint64_t>> signature;
+	for (auto& [name, scene] : loadedScenes) {
+		if (scene->isStatic) {
+			signature.push_back({ scene->sceneId, scene->hierarchy.version });
+		}
+	}
 
-	for (auto& s : mesh->surfaces) {
-		RenderObject def;
-		def.indexCount = s.count;
-		def.firstIndex = s.startIndex;
-		def.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
-		def.material = &s.material->data;
+	// a static scene was added, removed or edited, the frames record their bundle again on their next draw
+	if (signature != staticSignature) {
+		staticSignature = signature;
+		staticDrawContext.OpaqueSurfaces.clear();
+		staticDrawContext.TransparentSurfaces.clear();
+		for (auto& [name, scene] : loadedScenes) {
+			if (scene->isStatic) {
+				scene->Draw(glm::mat4{ 1.f }, staticDrawContext);
+			}
+		}
+		staticGeneration++;
+	}
 
-		def.transform = nodeMatrix;
-		def.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
-		
-		ctx.OpaqueSurfaces.push_back(def);
+	// transparent surfaces have to be sorted against the camera every frame, they stay on the dynamic path
+	mainDrawContext.TransparentSurfaces.insert(mainDrawContext.TransparentSurfaces.end(),
+		staticDrawContext.TransparentSurfaces.begin(), staticDrawContext.TransparentSurfaces.end());
+}
+
+void VulkanEngine::cullDrawContext()
+{
+	auto cullSurfaces = [&](std::vector<RenderObject>& surfaces) {
+		cullSpheres.clear();
+		for (const RenderObject& r : surfaces) {
+			cullSpheres.push(vkCull::transformSphere(r.transform, r.bounds.origin, r.bounds.sphereRadius));
+		}
+
+		vkCull::testSpheres(cameraFrustum, cullSpheres);
+
+		// compact the visible surfaces to the front, keeping their order
+		size_t kept = 0;
+		for (size_t i = 0; i < surfaces.size(); i++) {
+			if (cullSpheres.visible[i]) {
+				if (kept != i) {
+					surfaces[kept] = surfaces[i];
+				}
+				kept++;
+			}
+		}
+		stats.culled_count += static_cast<int>(surfaces.size() - kept);
+		surfaces.resize(kept);
+	};
+
+	cullSurfaces(mainDrawContext.OpaqueSurfaces);
+	cullSurfaces(mainDrawContext.TransparentSurfaces);
+}
+
+void VulkanEngine::pickScene(int x, int y)
+{
+	int width, height;
+	SDL_GetWindowSize(window, &width, &height);
+
+	// unproject the cursor at two depths, the draw image is stretched over the whole window
+	glm::mat4 inverseViewProj = glm::inverse(sceneData.viewproj);
+	float ndcX = 2.f * (x + 0.5f) / width - 1.f;
+	float ndcY = 2.f * (y + 0.5f) / height - 1.f;
+	glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndcX, ndcY, 1.f, 1.f);
+	glm::vec4 farPoint = inverseViewProj * glm::vec4(ndcX, ndcY, 0.f, 1.f);
+
+	glm::vec3 origin = camera.getTransformationR().getPositionR();
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w);
+	if (glm::dot(direction, camera.getTransformationR().getForwardVector()) < 0.f) {
+		direction = -direction;
 	}
 
-	
+	pickedNodeName.clear();
+	float closest = std::numeric_limits<float>::max();
+	for (auto& [name, scene] : loadedScenes) {
+		// scenes are drawn with an identity top matrix, so world space is the space of the file
+		std::optional<BVHRayHit> hit = scene->raycast(origin, direction);
+		if (hit && hit->distance < closest) {
+			closest = hit->distance;
+			pickedNodeName = name + "/" + scene->hierarchy.names[hit->userData];
+		}
+	}
+}
+
+void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx)
+{
+	emitMeshSurfaces(*mesh, topMatrix * worldTransform, ctx);
 
 	// recurse down
 	Node::Draw(topMatrix, ctx);
 }
 
+void emitMeshSurfaces(const MeshAsset& mesh, const glm::mat4& transform, DrawContext& ctx, VkDeviceAddress transformAddress)
+{
+	for (uint32_t surfaceIndex = 0; surfaceIndex < mesh.surfaces.size(); surfaceIndex++) {
+		const GeoSurface& s = mesh.surfaces[surfaceIndex];
+		RenderObject def;
+		def.indexCount = s.count;
+		def.firstIndex = mesh.meshBuffers.firstIndex + s.startIndex;
+		def.indexBuffer = mesh.meshBuffers.indexBuffer;
+		def.material = &s.material->data;
+
+		def.transform = transform;
+		def.vertexBufferAddress = mesh.meshBuffers.vertexBufferAddress;
+		def.meshId = mesh.meshBuffers.meshId;
+		def.surfaceIndex = surfaceIndex;
+		def.bounds = s.bounds;
+		def.transformAddress = transformAddress;
+
+		if (s.material->data.passType == MaterialPass::Transparent) {
+			ctx.TransparentSurfaces.push_back(def);
+		}
+		else {
+			ctx.OpaqueSurfaces.push_back(def);
+		}
+	}
+}
+
 
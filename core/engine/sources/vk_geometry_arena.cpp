@@ -0,0 +1,98 @@
+#include "vk_geometry_arena.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void GeometryArena::init(VulkanEngine* t_engine, uint32_t t_blockVertices, uint32_t t_blockIndices)
+{
+	m_engine = t_engine;
+	m_blockVertices = t_blockVertices;
+	m_blockIndices = t_blockIndices;
+}
+
+void GeometryArena::destroy()
+{
+	for (Block& block : m_blocks) {
+		m_engine->destroyBuffer(block.vertexBuffer);
+		m_engine->destroyBuffer(block.indexBuffer);
+	}
+	m_blocks.clear();
+}
+
+void GeometryArena::allocate(uint32_t t_vertexCount, uint32_t t_indexCount, GPUMeshBuffers& t_mesh)
+{
+	for (uint32_t blockIndex = 0; ; blockIndex++) {
+		if (blockIndex == m_blocks.size()) {
+			// meshes larger than a block get a block of their own size
+			addBlock(std::max(m_blockVertices, t_vertexCount), std::max(m_blockIndices, t_indexCount));
+		}
+
+		Block& block = m_blocks[blockIndex];
+		std::optional<uint32_t> firstVertex = block.vertices.allocate(t_vertexCount);
+		if (!firstVertex.has_value()) {
+			continue;
+		}
+		std::optional<uint32_t> firstIndex = block.indices.allocate(t_indexCount);
+		if (!firstIndex.has_value()) {
+			block.vertices.release(firstVertex.value(), t_vertexCount);
+			continue;
+		}
+
+		t_mesh.vertexBuffer = block.vertexBuffer.buffer;
+		t_mesh.indexBuffer = block.indexBuffer.buffer;
+		// the indices stay relative to the mesh, the vertex address points at its header and the vertices follow it
+		t_mesh.vertexBufferAddress = block.vertexAddress + firstVertex.value() * sizeof(PackedVertex);
+		t_mesh.firstVertex = firstVertex.value();
+		t_mesh.vertexCount = t_vertexCount;
+		t_mesh.firstIndex = firstIndex.value();
+		t_mesh.indexCount = t_indexCount;
+		t_mesh.arenaBlock = blockIndex;
+		return;
+	}
+}
+
+void GeometryArena::release(const GPUMeshBuffers& t_mesh)
+{
+	Block& block = m_blocks[t_mesh.arenaBlock];
+	block.vertices.release(t_mesh.firstVertex, t_mesh.vertexCount);
+	block.indices.release(t_mesh.firstIndex, t_mesh.indexCount);
+}
+
+bool GeometryArena::write(const GPUMeshBuffers& t_mesh, const void* t_vertices, const void* t_indices)
+{
+	Block& block = m_blocks[t_mesh.arenaBlock];
+	if (!block.hostVisible) {
+		return false;
+	}
+
+	const VkDeviceSize vertexOffset = t_mesh.firstVertex * sizeof(PackedVertex);
+	const VkDeviceSize indexOffset = t_mesh.firstIndex * sizeof(uint32_t);
+	std::memcpy((char*)block.vertexBuffer.info.pMappedData + vertexOffset, t_vertices, t_mesh.vertexCount * sizeof(PackedVertex));
+	std::memcpy((char*)block.indexBuffer.info.pMappedData + indexOffset, t_indices, t_mesh.indexCount * sizeof(uint32_t));
+	vmaFlushAllocation(m_engine->allocator, block.vertexBuffer.allocation, vertexOffset, t_mesh.vertexCount * sizeof(PackedVertex));
+	vmaFlushAllocation(m_engine->allocator, block.indexBuffer.allocation, indexOffset, t_mesh.indexCount * sizeof(uint32_t));
+	return true;
+}
+
+void GeometryArena::addBlock(uint32_t t_vertexCount, uint32_t t_indexCount)
+{
+	// vma may still fall back to plain vram, the block is only written in place when both buffers are host visible
+	const VmaMemoryUsage memoryUsage = m_engine->hostVisibleDeviceMemory ? VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE : VMA_MEMORY_USAGE_GPU_ONLY;
+	const VmaAllocationCreateFlags allocFlags = m_engine->hostVisibleDeviceMemory ? VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT : 0;
+
+	Block& block = m_blocks.emplace_back();
+	block.vertexBuffer = m_engine->createBuffer(t_vertexCount * sizeof(PackedVertex),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, memoryUsage, allocFlags);
+	block.indexBuffer = m_engine->createBuffer(t_indexCount * sizeof(uint32_t),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryUsage, allocFlags);
+	block.hostVisible = m_engine->hostVisibleDeviceMemory &&
+		m_engine->isHostVisibleDeviceLocal(block.vertexBuffer) && m_engine->isHostVisibleDeviceLocal(block.indexBuffer);
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = block.vertexBuffer.buffer;
+	block.vertexAddress = vkGetBufferDeviceAddress(m_engine->device, &addressInfo);
+
+	block.vertices.init(t_vertexCount);
+	block.indices.init(t_indexCount);
+}
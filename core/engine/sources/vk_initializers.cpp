@@ -16,7 +16,7 @@ namespace vkInit{
         
         
     VkCommandBufferAllocateInfo command_buffer_allocate_info(
-        VkCommandPool pool, uint32_t count /*= 1*/)
+        VkCommandPool pool, uint32_t count /*= 1*/, VkCommandBufferLevel level /*= VK_COMMAND_BUFFER_LEVEL_PRIMARY*/)
     {
         VkCommandBufferAllocateInfo info = {};
         info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -24,7 +24,7 @@ namespace vkInit{
         
         info.commandPool = pool;
         info.commandBufferCount = count;
-        info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        info.level = level;
         return info;
     }
 
@@ -1,9 +1,12 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
 #include <fastgltf/glm_element_traits.hpp>
 #include <fastgltf/tools.hpp>
 #include <stb_image.h>
 #include <iostream>
+#include <limits>
+#include <algorithm>
 #include <fastgltf/core.hpp>
 
 #include "vk_engine.hpp"
@@ -11,6 +14,9 @@
 #include "vk_types.hpp"
 
 #include "vk_loader.hpp"
+#include "vk_cooked.hpp"
+#include "vk_vertex_assembly.hpp"
+#include "vk_mesh_optimizer.hpp"
 
 
 bool loadGltf(fastgltf::Asset& gltfAsset, std::filesystem::path path) 
@@ -61,6 +67,38 @@ bool loadGltf(fastgltf::Asset& gltfAsset, std::filesystem::path path)
     return true;
 }
 
+Bounds computeBounds(std::span<const Vertex> vertices)
+{
+    Bounds bounds {};
+    if (vertices.empty()) {
+        return bounds;
+    }
+
+    glm::vec3 minpos = vertices[0].position;
+    glm::vec3 maxpos = vertices[0].position;
+    for (const Vertex& v : vertices) {
+        minpos = glm::min(minpos, v.position);
+        maxpos = glm::max(maxpos, v.position);
+    }
+
+    bounds.origin = (maxpos + minpos) / 2.f;
+    bounds.extents = (maxpos - minpos) / 2.f;
+    bounds.sphereRadius = glm::length(bounds.extents);
+    return bounds;
+}
+
+// the bounds of the surfaces were computed before and stay valid, only the order of the data changes
+// the surfaces are parallel to the primitives of the mesh
+static void optimizeSurfaces(const fastgltf::Mesh& mesh, const std::vector<GeoSurface>& surfaces, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+{
+    std::vector<IndexRange> ranges;
+    ranges.reserve(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        ranges.push_back({ surfaces[i].startIndex, surfaces[i].count, mesh.primitives[i].type });
+    }
+    vkMesh::optimizeMesh(indices, vertices, ranges);
+}
+
 std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadMesh(VulkanEngine* engine, std::filesystem::path path) {
     
     std::vector<std::shared_ptr<MeshAsset>> meshes;
@@ -74,6 +112,8 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadMesh(VulkanEngine* en
     std::vector<uint32_t> indices;
     std::vector<Vertex> vertices;
 
+    // display the vertex normals, written while the vertices are assembled
+    constexpr bool OverrideColors = true;
 
     for (fastgltf::Mesh& mesh : gltfAsset.meshes){
         MeshAsset newMesh;
@@ -89,71 +129,13 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadMesh(VulkanEngine* en
             newSurface.count = (uint32_t)gltfAsset.accessors[primitive.indicesAccessor.value()].count;
 
             size_t initial_vtx = vertices.size();
-             // load indexes
-             {
-                fastgltf::Accessor& indexaccessor = gltfAsset.accessors[primitive.indicesAccessor.value()];
-                indices.reserve(indices.size() + indexaccessor.count);
-
-                fastgltf::iterateAccessor<std::uint32_t>(gltfAsset, indexaccessor,
-                    [&](std::uint32_t idx) {
-                        indices.push_back(idx + initial_vtx);
-                    });
-            }
-            // load vertex positions
-            {
-                fastgltf::Accessor& posAccessor = gltfAsset.accessors[primitive.findAttribute("POSITION")->accessorIndex];
-                vertices.resize(vertices.size() + posAccessor.count);
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltfAsset, posAccessor,
-                    [&](glm::vec3 v, size_t index) {
-                        Vertex newvtx;
-                        newvtx.position = v;
-                        newvtx.normal = { 1, 0, 0 };
-                        newvtx.color = glm::vec4 { 1.f };
-                        newvtx.uvX = 0;
-                        newvtx.uvY = 0;
-                        vertices[initial_vtx + index] = newvtx;
-                    });
-            }
-             // load vertex normals
-             auto normals = primitive.findAttribute("NORMAL");
-             if (normals != primitive.attributes.end()) {
- 
-                 fastgltf::iterateAccessorWithIndex<glm::vec3>(gltfAsset, gltfAsset.accessors[(*normals).accessorIndex],
-                     [&](glm::vec3 v, size_t index) {
-                         vertices[initial_vtx + index].normal = v;
-                     });
-             }
-
-             // load UVs
-            auto uv = primitive.findAttribute("TEXCOORD_0");
-            if (uv != primitive.attributes.end()) {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(gltfAsset, gltfAsset.accessors[(*uv).accessorIndex],
-                    [&](glm::vec2 v, size_t index) {
-                        vertices[initial_vtx + index].uvX = v.x;
-                        vertices[initial_vtx + index].uvY = v.y;
-                    });
-            }
-
-            // load vertex colors
-            auto colors = primitive.findAttribute("COLOR_0");
-            if (colors != primitive.attributes.end()) {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(gltfAsset, gltfAsset.accessors[(*colors).accessorIndex],
-                    [&](glm::vec4 v, size_t index) {
-                        vertices[initial_vtx + index].color = v;
-                    });
-            }
+            loadPrimitive(gltfAsset, primitive, indices, vertices, &engine->workerThreads, OverrideColors);
+            newSurface.bounds = computeBounds(std::span<const Vertex>(vertices).subspan(initial_vtx));
             newMesh.surfaces.push_back(newSurface);
         }
 
-         // display the vertex normals
-         constexpr bool OverrideColors = true;
-         if (OverrideColors) {
-             for (Vertex& vtx : vertices) {
-                 vtx.color = glm::vec4(vtx.normal, 1.f);
-             }
+         if (engine->optimizeMeshes) {
+             optimizeSurfaces(mesh, newMesh.surfaces, indices, vertices);
          }
          newMesh.meshBuffers = engine->uploadMesh(indices, vertices);
  
@@ -163,26 +145,35 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadMesh(VulkanEngine* en
     return meshes;
 }
 
-std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::string_view filePath)
+Transformation decomposeNodeMatrix(const glm::mat4& matrix, std::string_view nodeName)
 {
-    if (!std::filesystem::exists(filePath)) {
-		std::cout << "Failed to find " << filePath << '\n';
-		return {};
-	}
-
-    fmt::print("Loading GLTF: {}", filePath);
-
-    std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
-    scene->creator = engine;
-    LoadedGLTF& file = *scene.get();
+    glm::vec3 tl, sc, skew;
+    glm::quat rot;
+    glm::vec4 perspective;
+    bool decomposed = glm::decompose(matrix, sc, rot, tl, skew, perspective);
+
+    // a zero scale axis normalizes to nan without decompose failing, the rotation is lost then anyway
+    decomposed = decomposed && !glm::any(glm::isnan(sc)) && !glm::any(glm::isnan(glm::vec4(rot.x, rot.y, rot.z, rot.w)));
+    if (!decomposed) {
+        std::cout << "Node " << nodeName << " has a degenerate matrix, its rotation is dropped\n";
+        return Transformation(glm::vec3(matrix[3]), glm::quat(1.f, 0.f, 0.f, 0.f),
+            glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+    }
+    if (skew != glm::vec3(0.f) || perspective != glm::vec4(0.f, 0.f, 0.f, 1.f)) {
+        std::cout << "Node " << nodeName << " has a skewed or projective matrix, only its TRS part is kept\n";
+    }
+    return Transformation(tl, rot, sc);
+}
 
+std::optional<fastgltf::Asset> parseGltf(const std::filesystem::path& path)
+{
     fastgltf::Parser parser {};
 
     constexpr auto gltfOptions = fastgltf::Options::DontRequireValidAssetMember | fastgltf::Options::AllowDouble | fastgltf::Options::LoadGLBBuffers | fastgltf::Options::LoadExternalBuffers;
     // fastgltf::Options::LoadExternalImages;
 
 
-    fastgltf::Expected<fastgltf::GltfDataBuffer> data = fastgltf::GltfDataBuffer::FromPath(filePath);
+    fastgltf::Expected<fastgltf::GltfDataBuffer> data = fastgltf::GltfDataBuffer::FromPath(path);
 
     if(data.error() !=fastgltf::Error::None){
         std::cout << "Failed to load data " << (int)data.error() << '\n';
@@ -191,8 +182,6 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
 
     fastgltf::Asset gltf;
 
-    std::filesystem::path path = filePath;
-
     auto type = fastgltf::determineGltfFileType(data.get());
     if (type == fastgltf::GltfType::glTF) {
         auto load = parser.loadGltfJson(data.get(), path.parent_path(), gltfOptions);
@@ -215,9 +204,92 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
         return {};
     }
 
+    return gltf;
+}
+
+void loadPrimitive(fastgltf::Asset& gltf, fastgltf::Primitive& p, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices,
+    ThreadPool* workers, bool colorsFromNormals)
+{
+    const size_t initial_vtx = vertices.size();
+    const size_t initial_idx = indices.size();
+
+    // load indexes, copied as a whole and then offset past the vertices already in the array
+    fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
+    indices.resize(initial_idx + indexaccessor.count);
+    fastgltf::copyFromAccessor<std::uint32_t>(gltf, indexaccessor, indices.data() + initial_idx);
+    vkVertex::offsetIndices(indices.data() + initial_idx, indexaccessor.count, static_cast<uint32_t>(initial_vtx), workers);
+
+    // every attribute is copied into a packed stream first, for float data that is a plain memcpy,
+    // then the streams are interleaved into the vertices in one pass
+    thread_local std::vector<glm::vec3> positions;
+    thread_local std::vector<glm::vec3> normals;
+    thread_local std::vector<glm::vec2> uvs;
+    thread_local std::vector<glm::vec4> colors;
+
+    fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
+    VertexStreams streams;
+    streams.count = posAccessor.count;
+    positions.resize(posAccessor.count);
+    fastgltf::copyFromAccessor<glm::vec3>(gltf, posAccessor, positions.data());
+    streams.positions = positions.data();
+
+    // attributes with fewer elements than positions are ignored rather than read out of bounds
+    auto copyAttribute = [&]<typename T>(std::string_view name, std::vector<T>& stream) -> const T* {
+        auto attribute = p.findAttribute(name);
+        if (attribute == p.attributes.end() || gltf.accessors[attribute->accessorIndex].count < streams.count) {
+            return nullptr;
+        }
+        fastgltf::Accessor& accessor = gltf.accessors[attribute->accessorIndex];
+        stream.resize(accessor.count);
+        fastgltf::copyFromAccessor<T>(gltf, accessor, stream.data());
+        return stream.data();
+    };
+    streams.normals = copyAttribute("NORMAL", normals);
+    streams.uvs = copyAttribute("TEXCOORD_0", uvs);
+    streams.colors = copyAttribute("COLOR_0", colors);
+
+    vertices.resize(initial_vtx + streams.count);
+    vkVertex::interleave(streams, vertices.data() + initial_vtx, colorsFromNormals, workers);
+}
+
+std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::string_view filePath)
+{
+    // a cooked copy skips parsing and vertex assembly, it is used as long as it is not older than the source
+    std::filesystem::path cookedPath = filePath;
+    if (cookedPath.extension() != cooked::FileExtension) {
+        cookedPath.replace_extension(cooked::FileExtension);
+    }
+    std::error_code error;
+    if (std::filesystem::exists(cookedPath, error)) {
+        const bool hasSource = std::filesystem::exists(filePath, error);
+        if (!hasSource || std::filesystem::last_write_time(cookedPath, error) >= std::filesystem::last_write_time(filePath, error)) {
+            std::optional<std::shared_ptr<LoadedGLTF>> cookedScene = loadCookedGltf(engine, cookedPath);
+            if (cookedScene.has_value() || !hasSource) {
+                return cookedScene;
+            }
+        }
+    }
+
+    if (!std::filesystem::exists(filePath)) {
+		std::cout << "Failed to find " << filePath << '\n';
+		return {};
+	}
+
+    fmt::print("Loading GLTF: {}", filePath);
+
+    std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
+    scene->creator = engine;
+    scene->sceneId = engine->nextSceneId++;
+    LoadedGLTF& file = *scene.get();
+
+    std::optional<fastgltf::Asset> parsed = parseGltf(filePath);
+    if (!parsed.has_value()) {
+        return {};
+    }
+    fastgltf::Asset& gltf = parsed.value();
+
     std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = { 
             { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 },
             { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 } 
     };
 
@@ -248,27 +320,37 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
     std::vector<std::shared_ptr<GLTFMaterial>> materials;
 
 
-    // load all textures
-    for (fastgltf::Image& image : gltf.images) {
-    
-        std::optional<AllocatedImage> img = loadImage(engine, gltf, image);
+    // load all textures, the png/jpeg decode runs on the worker threads a window at a time so only a
+    // few decoded images are alive at once, the uploads stay on this thread in file order
+    const uint32_t decodeWindow = 2 * (engine->workerThreads.getThreadCount() + 1);
+    std::vector<DecodedImage> decoded(decodeWindow);
+    for (uint32_t windowStart = 0; windowStart < gltf.images.size(); windowStart += decodeWindow) {
+        const uint32_t windowSize = std::min(decodeWindow, static_cast<uint32_t>(gltf.images.size()) - windowStart);
+        engine->workerThreads.parallelFor(windowSize, [&](uint32_t i) {
+            decoded[i] = decodeImage(gltf, gltf.images[windowStart + i]);
+        });
 
-		if (img.has_value()) {
-			images.push_back(*img);
-			file.images[image.name.c_str()] = *img;
-		}
-		else {
-			// we failed to load, so lets give the slot a default white texture to not
-			// completely break loading
-			images.push_back(engine->errorCheckerboardImage);
-			std::cout << "gltf failed to load texture " << image.name << std::endl;
-		}
+        for (uint32_t i = 0; i < windowSize; i++) {
+            fastgltf::Image& image = gltf.images[windowStart + i];
+            std::optional<AllocatedImage> img = uploadDecodedImage(engine, decoded[i]);
+
+            if (img.has_value()) {
+                images.push_back(*img);
+                file.images[image.name.c_str()] = *img;
+            }
+            else {
+                // we failed to load, so lets give the slot a default white texture to not
+                // completely break loading
+                images.push_back(engine->errorCheckerboardImage);
+                std::cout << "gltf failed to load texture " << image.name << std::endl;
+            }
+        }
     }
 
-    file.materialDataBuffer = engine->createBuffer(sizeof(GLTFMetallic_Roughness::MaterialConstants) * gltf.materials.size(),
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    int data_index = 0;
-    GLTFMetallic_Roughness::MaterialConstants* sceneMaterialConstants = (GLTFMetallic_Roughness::MaterialConstants*)file.materialDataBuffer.info.pMappedData;
+    // one contiguous range of the shared material table for the whole file
+    file.materialCount = static_cast<uint32_t>(gltf.materials.size());
+    file.firstMaterialIndex = engine->metalRoughMaterial.materialTable.allocate(file.materialCount);
+    uint32_t data_index = 0;
     
     for (fastgltf::Material& mat : gltf.materials) {
 
@@ -276,17 +358,6 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
         materials.push_back(newMat);
         file.materials[mat.name.c_str()] = newMat;
 
-        GLTFMetallic_Roughness::MaterialConstants constants;
-        constants.colorFactors.x = mat.pbrData.baseColorFactor[0];
-        constants.colorFactors.y = mat.pbrData.baseColorFactor[1];
-        constants.colorFactors.z = mat.pbrData.baseColorFactor[2];
-        constants.colorFactors.w = mat.pbrData.baseColorFactor[3];
-
-        constants.metalRoughFactors.x = mat.pbrData.metallicFactor;
-        constants.metalRoughFactors.y = mat.pbrData.roughnessFactor;
-        // write material parameters to buffer
-        sceneMaterialConstants[data_index] = constants;
-
         MaterialPass passType = MaterialPass::MainColor;
         if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
             passType = MaterialPass::Transparent;
@@ -299,16 +370,25 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
         materialResources.metalRoughImage = engine->whiteImage;
         materialResources.metalRoughSampler = engine->defaultSamplerLinear;
 
-        // set the uniform buffer for the material data
-        materialResources.dataBuffer = file.materialDataBuffer.buffer;
-        materialResources.dataBufferOffset = data_index * sizeof(GLTFMetallic_Roughness::MaterialConstants);
+        // material parameters, written into the shared material table
+        materialResources.colorFactors.x = mat.pbrData.baseColorFactor[0];
+        materialResources.colorFactors.y = mat.pbrData.baseColorFactor[1];
+        materialResources.colorFactors.z = mat.pbrData.baseColorFactor[2];
+        materialResources.colorFactors.w = mat.pbrData.baseColorFactor[3];
+
+        materialResources.metalRoughFactors.x = mat.pbrData.metallicFactor;
+        materialResources.metalRoughFactors.y = mat.pbrData.roughnessFactor;
+        materialResources.materialIndex = file.firstMaterialIndex + data_index;
         // grab textures from gltf file
         if (mat.pbrData.baseColorTexture.has_value()) {
-            size_t img = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].imageIndex.value();
-            size_t sampler = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex].samplerIndex.value();
-
-            materialResources.colorImage = images[img];
-            materialResources.colorSampler = file.samplers[sampler];
+            fastgltf::Texture& texture = gltf.textures[mat.pbrData.baseColorTexture.value().textureIndex];
+            // textures without a sampler use the default one, without a core image the default texture
+            if (texture.imageIndex.has_value()) {
+                materialResources.colorImage = images[texture.imageIndex.value()];
+            }
+            if (texture.samplerIndex.has_value()) {
+                materialResources.colorSampler = file.samplers[texture.samplerIndex.value()];
+            }
         }
         // build material
         newMat->data = engine->metalRoughMaterial.writeMaterial(engine->device, passType, materialResources, file.descriptorPool);
@@ -337,65 +417,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
             newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
 
             size_t initial_vtx = vertices.size();
-
-            // load indexes
-            {
-                fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
-                indices.reserve(indices.size() + indexaccessor.count);
-
-                fastgltf::iterateAccessor<std::uint32_t>(gltf, indexaccessor,
-                    [&](std::uint32_t idx) {
-                        indices.push_back(idx + initial_vtx);
-                    });
-            }
-
-            // load vertex positions
-            {
-                fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-                vertices.resize(vertices.size() + posAccessor.count);
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-                    [&](glm::vec3 v, size_t index) {
-                        Vertex newvtx;
-                        newvtx.position = v;
-                        newvtx.normal = { 1, 0, 0 };
-                        newvtx.color = glm::vec4 { 1.f };
-                        newvtx.uvX = 0;
-                        newvtx.uvY = 0;
-                        vertices[initial_vtx + index] = newvtx;
-                    });
-            }
-
-            // load vertex normals
-            auto normals = p.findAttribute("NORMAL");
-            if (normals != p.attributes.end()) {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[(*normals).accessorIndex],
-                    [&](glm::vec3 v, size_t index) {
-                        vertices[initial_vtx + index].normal = v;
-                    });
-            }
-
-            // load UVs
-            auto uv = p.findAttribute("TEXCOORD_0");
-            if (uv != p.attributes.end()) {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[(*uv).accessorIndex],
-                    [&](glm::vec2 v, size_t index) {
-                        vertices[initial_vtx + index].uvX = v.x;
-                        vertices[initial_vtx + index].uvY = v.y;
-                    });
-            }
-
-            // load vertex colors
-            auto colors = p.findAttribute("COLOR_0");
-            if (colors != p.attributes.end()) {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[(*colors).accessorIndex],
-                    [&](glm::vec4 v, size_t index) {
-                        vertices[initial_vtx + index].color = v;
-                    });
-            }
+            loadPrimitive(gltf, p, indices, vertices, &engine->workerThreads);
 
             if (p.materialIndex.has_value()) {
                 newSurface.material = materials[p.materialIndex.value()];
@@ -403,13 +425,22 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
                 newSurface.material = materials[0];
             }
 
+            newSurface.bounds = computeBounds(std::span<const Vertex>(vertices).subspan(initial_vtx));
+
             newmesh->surfaces.push_back(newSurface);
         }
 
+        if (engine->optimizeMeshes) {
+            optimizeSurfaces(mesh, newmesh->surfaces, indices, vertices);
+        }
         newmesh->meshBuffers = engine->uploadMesh(indices, vertices);
     }
 
 
+    // local transforms as TRS for the flat hierarchy, matrix nodes are decomposed
+    std::vector<Transformation> localTransformations;
+    localTransformations.reserve(gltf.nodes.size());
+
     // load all nodes and their meshes
     for (fastgltf::Node& node : gltf.nodes) {
         std::shared_ptr<Node> newNode;
@@ -423,11 +454,13 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
         }
 
         nodes.push_back(newNode);
-        file.nodes[node.name.c_str()];
+        file.nodes[node.name.c_str()] = newNode;
 
         std::visit(fastgltf::visitor { 
             [&](fastgltf::math::fmat4x4 matrix) {
                 memcpy(&newNode->localTransform, matrix.data(), sizeof(matrix));
+
+                localTransformations.push_back(decomposeNodeMatrix(newNode->localTransform, node.name));
             },
             [&](fastgltf::TRS transform) {
                 glm::vec3 tl(transform.translation[0], transform.translation[1],
@@ -441,12 +474,14 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
                 glm::mat4 sm = glm::scale(glm::mat4(1.f), sc);
 
                 newNode->localTransform = tm * rm * sm;
+                localTransformations.emplace_back(tl, rot, sc);
             }
         },
         node.transform);
     }
 
     // run loop again to setup transform hierarchy
+    std::vector<int32_t> gltfParents(gltf.nodes.size(), -1);
     for (int i = 0; i < gltf.nodes.size(); i++) {
         fastgltf::Node& node = gltf.nodes[i];
         std::shared_ptr<Node>& sceneNode = nodes[i];
@@ -454,6 +489,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
         for (auto& c : node.children) {
             sceneNode->children.push_back(nodes[c]);
             nodes[c]->parent = sceneNode;
+            gltfParents[c] = i;
         }
     }
 
@@ -464,6 +500,34 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,std::st
             node->refreshTransform(glm::mat4 { 1.f });
         }
     }
+
+    // flatten the tree breadth first so every parent lands before its children
+    file.meshList = meshes;
+    std::vector<uint32_t> pending;
+    std::vector<int32_t> flatIndices(gltf.nodes.size(), -1);
+    for (uint32_t i = 0; i < gltf.nodes.size(); i++) {
+        if (gltfParents[i] < 0) {
+            pending.push_back(i);
+        }
+    }
+    for (size_t cursor = 0; cursor < pending.size(); cursor++) {
+        uint32_t gltfIndex = pending[cursor];
+        fastgltf::Node& node = gltf.nodes[gltfIndex];
+
+        int32_t parent = gltfParents[gltfIndex] < 0 ? -1 : flatIndices[gltfParents[gltfIndex]];
+        int32_t meshIndex = node.meshIndex.has_value() ? static_cast<int32_t>(*node.meshIndex) : -1;
+        flatIndices[gltfIndex] = file.hierarchy.addNode(parent, localTransformations[gltfIndex], meshIndex, node.name.c_str());
+
+        for (auto& c : node.children) {
+            pending.push_back(static_cast<uint32_t>(c));
+        }
+    }
+    file.hierarchy.refreshTransforms(file.changedNodes);
+
+    file.buildBVH();
+
+    // submit every copy of the file as one batch, the loader does not wait for it
+    file.uploadTicket = engine->uploadQueue.flush();
     return scene;
 
  
@@ -502,47 +566,22 @@ VkSamplerMipmapMode extractMipmapMode(fastgltf::Filter filter)
     }
 }
 
-std::optional<AllocatedImage> loadImage(VulkanEngine* engine, fastgltf::Asset& asset, fastgltf::Image& image)
+DecodedImage decodeImage(fastgltf::Asset& asset, fastgltf::Image& image)
 {
-    AllocatedImage newImage {};
-
-    int width, height, nrChannels;
+    DecodedImage decoded {};
+    int width = 0, height = 0, nrChannels = 0;
 
     std::visit(fastgltf::visitor {
         [](auto& arg) {},
         [&](fastgltf::sources::URI& filePath) {
             assert(filePath.fileByteOffset == 0); // We don't support offsets with stbi.
             assert(filePath.uri.isLocalPath()); // We're only capable of loading local files.
-            int width, height, nrChannels;
 
             const std::string path(filePath.uri.path().begin(), filePath.uri.path().end()); // Thanks C++.
-            unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
-
-            if(data){
-                VkExtent3D imagesize;
-                imagesize.width = width;
-                imagesize.height = height;
-                imagesize.depth = 1;
-
-                newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT,false);
-            }
-           
-            stbi_image_free(data);
+            decoded.pixels = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
         },
         [&](fastgltf::sources::Array& vector) {
-            int width, height, nrChannels;
-            unsigned char *data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(vector.bytes.data()), static_cast<int>(vector.bytes.size()), &width, &height, &nrChannels, 4);
-            if (data) {
-                VkExtent3D imagesize;
-                imagesize.width = width;
-                imagesize.height = height;
-                imagesize.depth = 1;
-
-                newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT,false);
-
-          
-            }
-            stbi_image_free(data);
+            decoded.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(vector.bytes.data()), static_cast<int>(vector.bytes.size()), &width, &height, &nrChannels, 4);
         },
         [&](fastgltf::sources::BufferView& view) {
             auto& bufferView = asset.bufferViews[view.bufferViewIndex];
@@ -555,52 +594,240 @@ std::optional<AllocatedImage> loadImage(VulkanEngine* engine, fastgltf::Asset& a
                 // all buffers are already loaded into a vector.
                 [](auto& arg) {},
                 [&](fastgltf::sources::Array& vector) {
-                    int width, height, nrChannels;
-					unsigned char* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(vector.bytes.data() + bufferView.byteOffset),
-					                                            static_cast<int>(bufferView.byteLength), &width, &height, &nrChannels, 4);
-                    if (data) {
-                        VkExtent3D imagesize;
-                        imagesize.width = width;
-                        imagesize.height = height;
-                        imagesize.depth = 1;
-
-                        newImage = engine->createImage(data, imagesize, VK_FORMAT_R8G8B8A8_UNORM,
-                            VK_IMAGE_USAGE_SAMPLED_BIT,false);
-                    }
-                    stbi_image_free(data);
+					decoded.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(vector.bytes.data() + bufferView.byteOffset),
+					                                       static_cast<int>(bufferView.byteLength), &width, &height, &nrChannels, 4);
                 }
             }, buffer.data);
         },
     }, image.data);
 
+    if (decoded.pixels) {
+        decoded.extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
+    }
+    return decoded;
+}
 
-    // if any of the attempts to load the data failed, we havent written the image
-    // so handle is null
-    if (newImage.image == VK_NULL_HANDLE) {
+std::optional<AllocatedImage> uploadDecodedImage(VulkanEngine* engine, DecodedImage& decoded)
+{
+    // if the decode failed there is nothing to upload and the handle stays null
+    if (!decoded.pixels) {
         return {};
-    } else {
-        return newImage;
     }
+
+    AllocatedImage newImage = engine->createImage(decoded.pixels, decoded.extent, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, false);
+    stbi_image_free(decoded.pixels);
+    decoded.pixels = nullptr;
+    return newImage;
+}
+
+
+uint32_t SceneHierarchy::addNode(int32_t parent, const Transformation& localTransform, int32_t meshIndex, std::string name){
+    uint32_t index = static_cast<uint32_t>(parents.size());
+    parents.push_back(parent);
+    localTransforms.push_back(localTransform);
+    worldTransforms.push_back(glm::mat4 { 1.f });
+    meshIndices.push_back(meshIndex);
+    names.push_back(std::move(name));
+    dirty.push_back(1);
+    hasDirtyNodes = true;
+    version++;
+
+    uint32_t depth = parent < 0 ? 0 : depths[parent] + 1;
+    depths.push_back(depth);
+    if (depth >= levelOffsets.size()) {
+        levelOffsets.push_back(index);
+    }
+
+    if (meshIndex >= 0) {
+        meshNodes.push_back(index);
+    }
+    return index;
+}
+
+Transformation& SceneHierarchy::editLocalTransform(uint32_t index){
+    dirty[index] = 1;
+    hasDirtyNodes = true;
+    version++;
+    return localTransforms[index];
 }
 
+void SceneHierarchy::refreshTransforms(std::vector<uint32_t>& changed){
+    changed.clear();
+    if (!hasDirtyNodes) {
+        return;
+    }
+
+    // parents come first, so a dirty parent has already passed its flag down by the time a child is visited
+    localBatch.clear();
+    for (size_t i = 0; i < parents.size(); i++) {
+        int32_t parent = parents[i];
+        if (parent >= 0 && dirty[parent]) {
+            dirty[i] = 1;
+        }
+        if (dirty[i]) {
+            changed.push_back(static_cast<uint32_t>(i));
+            localBatch.push(localTransforms[i]);
+        }
+    }
+
+    // compose all the local matrices at once, then multiply them down the tree in the same order
+    localMatrices.resize(changed.size());
+    vkTransform::composeMatrices(localBatch, localMatrices.data());
+    vkTransform::propagateMatrices(worldTransforms.data(), localMatrices.data(), parents.data(), changed.data(), changed.size());
+
+    for (uint32_t index : changed) {
+        dirty[index] = 0;
+    }
+    hasDirtyNodes = false;
+}
 
 void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& ctx){
-    // create renderables from the scenenodes
-    for (auto& n : topNodes) {
-        n->Draw(topMatrix, ctx);
+    // the final matrices are cached between frames, they only need to be rebuilt when the top matrix changes.
+    // with the gpu writing them the cache is skipped, only the visible nodes compute one for sorting and culling
+    if (ctx.gpuTransforms) {
+        drawTopMatrix = topMatrix;
+        drawTransformsValid = false;
+    }
+    else if (!drawTransformsValid || topMatrix != drawTopMatrix) {
+        drawTransforms.resize(hierarchy.size());
+        for (uint32_t nodeIndex : hierarchy.meshNodes) {
+            drawTransforms[nodeIndex] = topMatrix * hierarchy.worldTransforms[nodeIndex];
+        }
+        drawTopMatrix = topMatrix;
+        drawTransformsValid = true;
+    }
+
+    if (ctx.frustum == nullptr || bvh.empty()) {
+        for (uint32_t nodeIndex : hierarchy.meshNodes) {
+            drawNode(nodeIndex, ctx);
+        }
+        return;
+    }
+
+    // bring the planes into the space of the file instead of transforming the bvh,
+    // dot(plane, topMatrix * p) == dot(transpose(topMatrix) * plane, p)
+    Frustum localFrustum;
+    glm::mat4 planeTransform = glm::transpose(topMatrix);
+    for (int i = 0; i < 6; i++) {
+        localFrustum.planes[i] = planeTransform * ctx.frustum->planes[i];
+    }
+
+    visibleNodes.clear();
+    bvh.cull(localFrustum, visibleNodes);
+    for (uint32_t nodeIndex : visibleNodes) {
+        drawNode(nodeIndex, ctx);
     }
  }
 
+void LoadedGLTF::drawNode(uint32_t nodeIndex, DrawContext& ctx) const {
+    const MeshAsset& mesh = *meshList[hierarchy.meshIndices[nodeIndex]];
+
+    if (!ctx.gpuTransforms) {
+        emitMeshSurfaces(mesh, drawTransforms[nodeIndex], ctx);
+        return;
+    }
+
+    // the matrix is still given for sorting and culling, the instance slot is filled on the gpu
+    VkDeviceAddress transformAddress = 0;
+    if (gpuWorldAddress != 0) {
+        transformAddress = gpuWorldAddress + nodeIndex * sizeof(glm::mat4);
+    }
+    emitMeshSurfaces(mesh, drawTopMatrix * hierarchy.worldTransforms[nodeIndex], ctx, transformAddress);
+}
+
+AABB LoadedGLTF::meshNodeBounds(uint32_t nodeIndex) const {
+    const MeshAsset& mesh = *meshList[hierarchy.meshIndices[nodeIndex]];
+    const glm::mat4& transform = hierarchy.worldTransforms[nodeIndex];
+    if (mesh.surfaces.empty()) {
+        glm::vec3 position = glm::vec3(transform[3]);
+        return AABB { position, position };
+    }
+
+    AABB bounds = vkBVH::transformBox(transform, mesh.surfaces[0].bounds.origin, mesh.surfaces[0].bounds.extents);
+    for (const GeoSurface& surface : mesh.surfaces) {
+        bounds = vkBVH::merge(bounds, vkBVH::transformBox(transform, surface.bounds.origin, surface.bounds.extents));
+    }
+    return bounds;
+}
+
+void LoadedGLTF::buildBVH(){
+    std::vector<BVHItem> items;
+    items.reserve(hierarchy.meshNodes.size());
+    for (uint32_t nodeIndex : hierarchy.meshNodes) {
+        items.push_back(BVHItem { meshNodeBounds(nodeIndex), nodeIndex });
+    }
+    meshNodeProxies = bvh.build(items);
+}
+
+void LoadedGLTF::refreshTransforms(bool gpuTransforms){
+    hierarchy.refreshTransforms(changedNodes);
+    if (changedNodes.empty()) {
+        return;
+    }
+
+    // every copy of the gpu nodes gets the changed ones written again, levels are contiguous so the first
+    // changed node is on the shallowest level that has to be propagated again
+    for (size_t copy = 0; copy < gpuPendingNodes.size(); copy++) {
+        if (gpuNodeRewrite[copy]) {
+            continue;
+        }
+        std::vector<uint32_t>& pending = gpuPendingNodes[copy];
+        if (pending.size() + changedNodes.size() > hierarchy.size()) {
+            pending.clear();
+            gpuNodeRewrite[copy] = 1;
+            continue;
+        }
+        pending.insert(pending.end(), changedNodes.begin(), changedNodes.end());
+    }
+    gpuDirtyLevel = std::min(gpuDirtyLevel, hierarchy.depths[changedNodes.front()]);
+
+    if (gpuTransforms) {
+        drawTransformsValid = false;
+    }
+
+    // a large part of the file moving at once is refitted in a single pass instead of re-inserting every leaf
+    const bool refitTree = changedNodes.size() * 4 > hierarchy.size();
+
+    // proxies are parallel to hierarchy.meshNodes, which is sorted like the changed list
+    size_t proxy = 0;
+    for (uint32_t nodeIndex : changedNodes) {
+        if (hierarchy.meshIndices[nodeIndex] < 0) {
+            continue;
+        }
+        while (hierarchy.meshNodes[proxy] != nodeIndex) {
+            proxy++;
+        }
+        if (refitTree) {
+            bvh.setProxyBounds(meshNodeProxies[proxy], meshNodeBounds(nodeIndex));
+        }
+        else {
+            bvh.moveProxy(meshNodeProxies[proxy], meshNodeBounds(nodeIndex));
+        }
+        if (drawTransformsValid) {
+            drawTransforms[nodeIndex] = drawTopMatrix * hierarchy.worldTransforms[nodeIndex];
+        }
+    }
+    if (refitTree) {
+        bvh.refit();
+    }
+}
+
+std::optional<BVHRayHit> LoadedGLTF::raycast(const glm::vec3& origin, const glm::vec3& direction) const {
+    return bvh.raycast(origin, direction, std::numeric_limits<float>::max());
+}
+
  void LoadedGLTF::clearAll(){
     VkDevice dv = creator->device;
 
+    // the arena ranges may be handed out again, no copy into them can still be running
+    creator->uploadQueue.wait(uploadTicket);
+
     descriptorPool.destroyPools(dv);
-    creator->destroyBuffer(materialDataBuffer);
+    creator->metalRoughMaterial.releaseMaterials(firstMaterialIndex, materialCount);
 
     for (auto& [k, v] : meshes) {
 
-		creator->destroyBuffer(v->meshBuffers.indexBuffer);
-		creator->destroyBuffer(v->meshBuffers.vertexBuffer);
+		creator->releaseMesh(v->meshBuffers);
     }
 
     for (auto& [k, v] : images) {
@@ -615,4 +842,9 @@ void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& ctx){
 	for (auto& sampler : samplers) {
 		vkDestroySampler(dv, sampler, nullptr);
     }
+
+    if (gpuNodeBuffer.buffer != VK_NULL_HANDLE) {
+        creator->destroyBuffer(gpuNodeBuffer);
+        creator->destroyBuffer(gpuWorldBuffer);
+    }
  }
\ No newline at end of file
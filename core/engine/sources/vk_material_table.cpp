@@ -0,0 +1,101 @@
+#include "vk_material_table.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void MaterialTable::init(VulkanEngine* t_engine, uint32_t t_initialCapacity)
+{
+	m_engine = t_engine;
+	m_pending.assign(FRAME_OVERLAP, {});
+	grow(std::max(t_initialCapacity, 1u));
+}
+
+void MaterialTable::destroy()
+{
+	if (m_buffer.buffer != VK_NULL_HANDLE) {
+		m_engine->destroyBuffer(m_buffer);
+		m_buffer = {};
+	}
+	m_address = 0;
+	m_entries.clear();
+	m_pending.clear();
+	m_ranges.clear();
+}
+
+uint32_t MaterialTable::allocate(uint32_t t_count)
+{
+	std::optional<uint32_t> first = m_ranges.allocate(t_count);
+	if (!first.has_value()) {
+		// the grown part is merged with a free tail, so the allocation fits after growing once
+		grow(std::max(getCapacity() * 2, getCapacity() + t_count - m_ranges.getFreeTail()));
+		first = m_ranges.allocate(t_count);
+	}
+	return first.value();
+}
+
+void MaterialTable::release(uint32_t t_first, uint32_t t_count)
+{
+	m_ranges.release(t_first, t_count);
+}
+
+void MaterialTable::write(uint32_t t_index, const GPUMaterialData& t_data)
+{
+	m_entries[t_index] = t_data;
+	for (std::vector<uint32_t>& pending : m_pending) {
+		pending.push_back(t_index);
+	}
+}
+
+void MaterialTable::beginFrame(uint32_t t_frameIndex)
+{
+	m_frameIndex = t_frameIndex;
+	std::vector<uint32_t>& pending = m_pending[t_frameIndex];
+	if (pending.empty()) {
+		return;
+	}
+
+	const size_t copyOffset = size_t(t_frameIndex) * getCapacity() * sizeof(GPUMaterialData);
+	GPUMaterialData* copy = (GPUMaterialData*)((char*)m_buffer.info.pMappedData + copyOffset);
+	uint32_t first = pending[0];
+	uint32_t last = pending[0];
+	for (uint32_t index : pending) {
+		copy[index] = m_entries[index];
+		first = std::min(first, index);
+		last = std::max(last, index);
+	}
+	vmaFlushAllocation(m_engine->allocator, m_buffer.allocation, copyOffset + first * sizeof(GPUMaterialData), (last - first + 1) * sizeof(GPUMaterialData));
+	pending.clear();
+}
+
+void MaterialTable::grow(uint32_t t_minCapacity)
+{
+	const uint32_t oldCapacity = getCapacity();
+	m_entries.resize(t_minCapacity);
+
+	// every copy starts out with the cpu copy, writes not uploaded yet are part of it
+	const size_t copySize = t_minCapacity * sizeof(GPUMaterialData);
+	AllocatedBuffer newBuffer = m_engine->createBuffer(FRAME_OVERLAP * copySize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	for (int copy = 0; copy < FRAME_OVERLAP; copy++) {
+		std::memcpy((char*)newBuffer.info.pMappedData + copy * copySize, m_entries.data(), oldCapacity * sizeof(GPUMaterialData));
+		vmaFlushAllocation(m_engine->allocator, newBuffer.allocation, copy * copySize, oldCapacity * sizeof(GPUMaterialData));
+		m_pending[copy].clear();
+	}
+
+	// frames in flight may still read the old table, it goes away with the deletion queue of this frame
+	if (m_buffer.buffer != VK_NULL_HANDLE) {
+		AllocatedBuffer oldBuffer = m_buffer;
+		VulkanEngine* engine = m_engine;
+		m_engine->getCurrentFrame().deletionQueue.pushFunction([=]() {
+			engine->destroyBuffer(oldBuffer);
+		});
+	}
+	m_buffer = newBuffer;
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = m_buffer.buffer;
+	m_address = vkGetBufferDeviceAddress(m_engine->device, &addressInfo);
+
+	m_ranges.grow(t_minCapacity);
+}
@@ -0,0 +1,346 @@
+#include "vk_mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <string.h>
+
+namespace {
+
+    constexpr uint32_t kUnused = ~0u;
+
+    uint32_t hashVertex(const Vertex& t_vertex)
+    {
+        static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0, "vertices are hashed as 32 bit words");
+
+        // murmur2 mixing over the raw words, welding is bitwise anyway
+        uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+        memcpy(words, &t_vertex, sizeof(Vertex));
+
+        constexpr uint32_t m = 0x5bd1e995;
+        uint32_t h = 0;
+        for (uint32_t w : words) {
+            w *= m;
+            w ^= w >> 24;
+            w *= m;
+            h *= m;
+            h ^= w;
+        }
+        return h;
+    }
+
+    // true when the vertex missed the simulated FIFO cache, it is then pushed with the current time
+    bool touchCache(std::vector<uint32_t>& t_stamps, uint32_t& t_time, uint32_t t_vertex)
+    {
+        if (t_time - t_stamps[t_vertex] > vkMesh::CacheSize) {
+            t_stamps[t_vertex] = t_time++;
+            return true;
+        }
+        return false;
+    }
+}
+
+size_t vkMesh::weldVertices(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices)
+{
+    const size_t count = t_vertices.size();
+    if (count == 0) {
+        return 0;
+    }
+
+    // open addressing, kept at most half full
+    size_t tableSize = 16;
+    while (tableSize < count * 2) {
+        tableSize *= 2;
+    }
+    const size_t mask = tableSize - 1;
+    std::vector<uint32_t> table(tableSize, kUnused);
+    std::vector<uint32_t> remap(count);
+    std::vector<Vertex> unique;
+    unique.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const Vertex& vertex = t_vertices[i];
+        size_t slot = hashVertex(vertex) & mask;
+        while (table[slot] != kUnused && memcmp(&unique[table[slot]], &vertex, sizeof(Vertex)) != 0) {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] == kUnused) {
+            table[slot] = static_cast<uint32_t>(unique.size());
+            unique.push_back(vertex);
+        }
+        remap[i] = table[slot];
+    }
+
+    if (unique.size() == count) {
+        return count;
+    }
+    for (uint32_t& index : t_indices) {
+        index = remap[index];
+    }
+    t_vertices = std::move(unique);
+    return t_vertices.size();
+}
+
+void vkMesh::optimizeVertexCache(uint32_t* t_indices, size_t t_indexCount, size_t t_vertexCount)
+{
+    const size_t triangleCount = t_indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // triangles around every vertex and how many of them are not emitted yet
+    std::vector<uint32_t> live(t_vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        live[t_indices[i]]++;
+    }
+    std::vector<uint32_t> offsets(t_vertexCount + 1, 0);
+    for (size_t v = 0; v < t_vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            adjacency[fill[t_indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> stamps(t_vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> ordered;
+    deadEnds.reserve(triangleCount * 3);
+    ordered.reserve(triangleCount * 3);
+
+    uint32_t time = CacheSize + 1;
+    size_t cursor = 0;
+    uint32_t fan = t_indices[0];
+    for (;;) {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+            const uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = 1;
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t v = t_indices[t * 3 + k];
+                ordered.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                touchCache(stamps, time, v);
+            }
+        }
+
+        // next fan: the oldest candidate that stays in the cache while its own triangles are emitted
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - stamps[v] + 2 * live[v] <= CacheSize) {
+                priority = time - stamps[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // dead end, go back to recently used vertices and then scan the rest in input order
+        while (next < 0 && !deadEnds.empty()) {
+            const uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0) {
+                next = v;
+            }
+        }
+        while (next < 0 && cursor < t_vertexCount) {
+            if (live[cursor] > 0) {
+                next = static_cast<int64_t>(cursor);
+            }
+            cursor++;
+        }
+        if (next < 0) {
+            break;
+        }
+        fan = static_cast<uint32_t>(next);
+    }
+
+    std::copy(ordered.begin(), ordered.end(), t_indices);
+}
+
+void vkMesh::optimizeOverdraw(uint32_t* t_indices, size_t t_indexCount, const glm::vec3* t_positions, size_t t_vertexCount, float t_threshold)
+{
+    const size_t triangleCount = t_indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // a triangle missing all three vertices starts over in the cache anyway, those are the hard cluster boundaries
+    std::vector<uint32_t> hardStarts;
+    std::vector<uint32_t> stamps(t_vertexCount, 0);
+    uint32_t time = CacheSize + 1;
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++) {
+            misses += touchCache(stamps, time, t_indices[t * 3 + k]) ? 1 : 0;
+        }
+        if (t == 0 || misses == 3) {
+            hardStarts.push_back(static_cast<uint32_t>(t));
+        }
+    }
+    hardStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    // hard clusters are split further once the acmr since the last cut, with the cache flushed there, falls to
+    // t_threshold times the acmr of the whole cluster. the cuts cost at most that much of the cache hit rate
+    std::vector<uint32_t> clusterStarts;
+    for (size_t h = 0; h + 1 < hardStarts.size(); h++) {
+        const uint32_t begin = hardStarts[h];
+        const uint32_t end = hardStarts[h + 1];
+
+        time += CacheSize + 1;
+        uint32_t clusterMisses = 0;
+        for (uint32_t t = begin; t < end; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                clusterMisses += touchCache(stamps, time, t_indices[t * 3 + k]) ? 1 : 0;
+            }
+        }
+        const float limit = t_threshold * float(clusterMisses) / float(end - begin);
+
+        time += CacheSize + 1;
+        clusterStarts.push_back(begin);
+        uint32_t misses = 0;
+        uint32_t triangles = 0;
+        for (uint32_t t = begin; t < end; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                misses += touchCache(stamps, time, t_indices[t * 3 + k]) ? 1 : 0;
+            }
+            triangles++;
+            if (t + 1 < end && float(misses) <= limit * float(triangles)) {
+                clusterStarts.push_back(t + 1);
+                time += CacheSize + 1;
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+    const size_t clusterCount = clusterStarts.size();
+    if (clusterCount < 2) {
+        return;
+    }
+    clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    // area weighted centroid and normal of every cluster
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.f));
+    std::vector<float> areas(clusterCount, 0.f);
+    glm::vec3 meshCentroid{ 0.f };
+    float meshArea = 0.f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            const glm::vec3& p0 = t_positions[t_indices[t * 3 + 0]];
+            const glm::vec3& p1 = t_positions[t_indices[t * 3 + 1]];
+            const glm::vec3& p2 = t_positions[t_indices[t * 3 + 2]];
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+
+            centroids[c] += (p0 + p1 + p2) * (area / 3.f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea <= 0.f) {
+        return;
+    }
+    meshCentroid = meshCentroid / meshArea;
+
+    // clusters facing away from the center are the likely occluders, they are drawn first
+    std::vector<float> sortKeys(clusterCount, 0.f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        const float normalLength = glm::length(normals[c]);
+        if (areas[c] > 0.f && normalLength > 0.f) {
+            sortKeys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+        }
+    }
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(triangleCount * 3);
+    for (uint32_t c : order) {
+        ordered.insert(ordered.end(), t_indices + clusterStarts[c] * 3, t_indices + clusterStarts[c + 1] * 3);
+    }
+    std::copy(ordered.begin(), ordered.end(), t_indices);
+}
+
+size_t vkMesh::optimizeVertexFetch(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices)
+{
+    std::vector<uint32_t> remap(t_vertices.size(), kUnused);
+    std::vector<Vertex> ordered;
+    ordered.reserve(t_vertices.size());
+    for (uint32_t& index : t_indices) {
+        if (remap[index] == kUnused) {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(t_vertices[index]);
+        }
+        index = remap[index];
+    }
+    t_vertices = std::move(ordered);
+    return t_vertices.size();
+}
+
+void vkMesh::optimizeMesh(std::vector<uint32_t>& t_indices, std::vector<Vertex>& t_vertices, std::span<const IndexRange> t_ranges)
+{
+    // a broken file is uploaded as authored rather than optimized out of bounds
+    const size_t vertexCount = t_vertices.size();
+    if (std::any_of(t_indices.begin(), t_indices.end(), [&](uint32_t t_index) { return t_index >= vertexCount; })) {
+        return;
+    }
+
+    weldVertices(t_indices, t_vertices);
+
+    // every range is renumbered to the vertices it uses, so the per range work does not scale with the whole mesh
+    std::vector<uint32_t> localIndex(t_vertices.size(), kUnused);
+    std::vector<uint32_t> meshIndex;
+    std::vector<glm::vec3> positions;
+    for (const IndexRange& range : t_ranges) {
+        // strips and fans can have a multiple of 3 indices too, only the topology tells them apart
+        if (range.topology != fastgltf::PrimitiveType::Triangles ||
+            range.count == 0 || range.count % 3 != 0 || size_t(range.start) + range.count > t_indices.size()) {
+            continue;
+        }
+        uint32_t* indices = t_indices.data() + range.start;
+
+        meshIndex.clear();
+        positions.clear();
+        for (uint32_t i = 0; i < range.count; i++) {
+            uint32_t& local = localIndex[indices[i]];
+            if (local == kUnused) {
+                local = static_cast<uint32_t>(meshIndex.size());
+                meshIndex.push_back(indices[i]);
+                positions.push_back(t_vertices[indices[i]].position);
+            }
+            indices[i] = local;
+        }
+
+        optimizeVertexCache(indices, range.count, meshIndex.size());
+        optimizeOverdraw(indices, range.count, positions.data(), meshIndex.size());
+
+        for (uint32_t i = 0; i < range.count; i++) {
+            indices[i] = meshIndex[indices[i]];
+        }
+        for (uint32_t v : meshIndex) {
+            localIndex[v] = kUnused;
+        }
+    }
+
+    optimizeVertexFetch(t_indices, t_vertices);
+}
@@ -0,0 +1,76 @@
+#include "vk_range_allocator.hpp"
+
+#include <algorithm>
+
+void RangeAllocator::init(uint32_t t_capacity)
+{
+	clear();
+	grow(t_capacity);
+}
+
+void RangeAllocator::clear()
+{
+	m_capacity = 0;
+	m_freeRanges.clear();
+}
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t t_count)
+{
+	if (t_count == 0) {
+		return 0;
+	}
+
+	// first fit, the owners see a few allocations per loaded file
+	for (size_t i = 0; i < m_freeRanges.size(); i++) {
+		Range& range = m_freeRanges[i];
+		if (range.count >= t_count) {
+			uint32_t first = range.first;
+			range.first += t_count;
+			range.count -= t_count;
+			if (range.count == 0) {
+				m_freeRanges.erase(m_freeRanges.begin() + i);
+			}
+			return first;
+		}
+	}
+	return std::nullopt;
+}
+
+void RangeAllocator::release(uint32_t t_first, uint32_t t_count)
+{
+	if (t_count == 0) {
+		return;
+	}
+
+	auto next = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), t_first,
+		[](const Range& range, uint32_t first) { return range.first < first; });
+	next = m_freeRanges.insert(next, { t_first, t_count });
+
+	// merge with the neighbours to keep the list short
+	if (next + 1 != m_freeRanges.end() && next->first + next->count == (next + 1)->first) {
+		next->count += (next + 1)->count;
+		m_freeRanges.erase(next + 1);
+	}
+	if (next != m_freeRanges.begin() && (next - 1)->first + (next - 1)->count == next->first) {
+		(next - 1)->count += next->count;
+		m_freeRanges.erase(next);
+	}
+}
+
+void RangeAllocator::grow(uint32_t t_capacity)
+{
+	if (t_capacity <= m_capacity) {
+		return;
+	}
+	const uint32_t oldCapacity = m_capacity;
+	m_capacity = t_capacity;
+	release(oldCapacity, t_capacity - oldCapacity);
+}
+
+uint32_t RangeAllocator::getFreeTail() const
+{
+	if (!m_freeRanges.empty() && m_freeRanges.back().first + m_freeRanges.back().count == m_capacity) {
+		return m_freeRanges.back().count;
+	}
+	return 0;
+}
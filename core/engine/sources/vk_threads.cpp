@@ -0,0 +1,97 @@
+#include "vk_threads.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+void ThreadPool::start(uint32_t t_threadCount)
+{
+	m_stopping = false;
+	for (uint32_t i = 0; i < t_threadCount; i++) {
+		m_threads.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wakeUp.notify_all();
+
+	for (std::thread& thread : m_threads) {
+		thread.join();
+	}
+	m_threads.clear();
+}
+
+void ThreadPool::submit(std::function<void()> t_task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(t_task));
+	}
+	m_wakeUp.notify_one();
+}
+
+void ThreadPool::parallelFor(uint32_t t_count, const std::function<void(uint32_t)>& t_job)
+{
+	if (t_count == 0) {
+		return;
+	}
+
+	// shared with the helper tasks, a helper that starts after everything is done only touches this state
+	struct State {
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> done{ 0 };
+		uint32_t count{ 0 };
+		const std::function<void(uint32_t)>* job{ nullptr };
+		std::mutex mutex{};
+		std::condition_variable finished{};
+	};
+	auto state = std::make_shared<State>();
+	state->count = t_count;
+	state->job = &t_job;
+
+	auto run = [state]() {
+		for (;;) {
+			uint32_t index = state->next.fetch_add(1);
+			if (index >= state->count) {
+				return;
+			}
+			(*state->job)(index);
+			if (state->done.fetch_add(1) + 1 == state->count) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	// the calling thread takes part, so one helper less is needed
+	uint32_t helpers = std::min(getThreadCount(), t_count - 1);
+	for (uint32_t i = 0; i < helpers; i++) {
+		submit(run);
+	}
+	run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&]() { return state->done.load() == state->count; });
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeUp.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_tasks.empty()) {
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
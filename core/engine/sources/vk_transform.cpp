@@ -1,6 +1,219 @@
 #include "vk_transform.hpp"
 
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define JADE_TRANSFORM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define JADE_TRANSFORM_SSE
+#endif
+
+#if defined(JADE_TRANSFORM_AVX) || defined(JADE_TRANSFORM_SSE)
+    #define JADE_TRANSFORM_SIMD
+#endif
+
 
 const glm::vec3 Transformation::kGlobalRight = glm::vec3(1.0f,0.0f,0.0f);
 const glm::vec3 Transformation::kGlobalUp = glm::vec3(0.0f,1.0f,0.0f);
-const glm::vec3 Transformation::kGlobalForward = glm::vec3(0.0f,0.0f,-1.0f);
\ No newline at end of file
+const glm::vec3 Transformation::kGlobalForward = glm::vec3(0.0f,0.0f,-1.0f);
+
+void TransformationBatch::clear()
+{
+    positionX.clear(); positionY.clear(); positionZ.clear();
+    rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+    scaleX.clear(); scaleY.clear(); scaleZ.clear();
+}
+
+void TransformationBatch::push(const Transformation& t_transformation)
+{
+    const glm::vec3& position = t_transformation.getPositionR();
+    const glm::quat& rotation = t_transformation.getRotationR();
+    const glm::vec3& scale = t_transformation.getScaleR();
+
+    positionX.push_back(position.x); positionY.push_back(position.y); positionZ.push_back(position.z);
+    rotationX.push_back(rotation.x); rotationY.push_back(rotation.y); rotationZ.push_back(rotation.z); rotationW.push_back(rotation.w);
+    scaleX.push_back(scale.x); scaleY.push_back(scale.y); scaleZ.push_back(scale.z);
+}
+
+namespace {
+
+    void composeMatrix(const TransformationBatch& t_batch, size_t t_index, float* t_out)
+    {
+        const float x = t_batch.rotationX[t_index], y = t_batch.rotationY[t_index];
+        const float z = t_batch.rotationZ[t_index], w = t_batch.rotationW[t_index];
+        const float sx = t_batch.scaleX[t_index], sy = t_batch.scaleY[t_index], sz = t_batch.scaleZ[t_index];
+
+        const float xx = x * x, yy = y * y, zz = z * z;
+        const float xy = x * y, xz = x * z, yz = y * z;
+        const float wx = w * x, wy = w * y, wz = w * z;
+
+        // columns of the rotation matrix scaled per axis, glm::mat4_cast layout
+        t_out[0] = (1.f - 2.f * (yy + zz)) * sx;
+        t_out[1] = 2.f * (xy + wz) * sx;
+        t_out[2] = 2.f * (xz - wy) * sx;
+        t_out[3] = 0.f;
+        t_out[4] = 2.f * (xy - wz) * sy;
+        t_out[5] = (1.f - 2.f * (xx + zz)) * sy;
+        t_out[6] = 2.f * (yz + wx) * sy;
+        t_out[7] = 0.f;
+        t_out[8] = 2.f * (xz + wy) * sz;
+        t_out[9] = 2.f * (yz - wx) * sz;
+        t_out[10] = (1.f - 2.f * (xx + yy)) * sz;
+        t_out[11] = 0.f;
+        t_out[12] = t_batch.positionX[t_index];
+        t_out[13] = t_batch.positionY[t_index];
+        t_out[14] = t_batch.positionZ[t_index];
+        t_out[15] = 1.f;
+    }
+
+#if defined(JADE_TRANSFORM_SIMD)
+    // the inputs hold one matrix element for 4 matrices, transposing each column group gives the columns of those matrices
+    void storeMatrices(float* t_out, __m128 t_m00, __m128 t_m01, __m128 t_m02,
+                       __m128 t_m10, __m128 t_m11, __m128 t_m12,
+                       __m128 t_m20, __m128 t_m21, __m128 t_m22,
+                       __m128 t_tx, __m128 t_ty, __m128 t_tz)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+
+        __m128 columns[4][4] = {
+            { t_m00, t_m01, t_m02, zero },
+            { t_m10, t_m11, t_m12, zero },
+            { t_m20, t_m21, t_m22, zero },
+            { t_tx, t_ty, t_tz, one },
+        };
+        for (int column = 0; column < 4; column++) {
+            _MM_TRANSPOSE4_PS(columns[column][0], columns[column][1], columns[column][2], columns[column][3]);
+        }
+        for (int matrix = 0; matrix < 4; matrix++) {
+            for (int column = 0; column < 4; column++) {
+                _mm_storeu_ps(t_out + matrix * 16 + column * 4, columns[column][matrix]);
+            }
+        }
+    }
+#endif
+}
+
+namespace vkTransform {
+
+    void composeMatrices(const TransformationBatch& t_batch, glm::mat4* t_out)
+    {
+        const size_t count = t_batch.size();
+        float* out = &t_out[0][0][0];
+
+        size_t i = 0;
+
+#if defined(JADE_TRANSFORM_AVX)
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256 two = _mm256_set1_ps(2.f);
+
+        for (; i + 8 <= count; i += 8) {
+            const __m256 x = _mm256_loadu_ps(t_batch.rotationX.data() + i);
+            const __m256 y = _mm256_loadu_ps(t_batch.rotationY.data() + i);
+            const __m256 z = _mm256_loadu_ps(t_batch.rotationZ.data() + i);
+            const __m256 w = _mm256_loadu_ps(t_batch.rotationW.data() + i);
+            const __m256 sx = _mm256_loadu_ps(t_batch.scaleX.data() + i);
+            const __m256 sy = _mm256_loadu_ps(t_batch.scaleY.data() + i);
+            const __m256 sz = _mm256_loadu_ps(t_batch.scaleZ.data() + i);
+
+            const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+            const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+            const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+            const __m256 m00 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+            const __m256 m01 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+            const __m256 m02 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+            const __m256 m10 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+            const __m256 m11 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+            const __m256 m12 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+            const __m256 m20 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+            const __m256 m21 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+            const __m256 m22 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+            const __m256 tx = _mm256_loadu_ps(t_batch.positionX.data() + i);
+            const __m256 ty = _mm256_loadu_ps(t_batch.positionY.data() + i);
+            const __m256 tz = _mm256_loadu_ps(t_batch.positionZ.data() + i);
+
+            // the transpose is done on 128 bit halves, lanes do not cross them
+            storeMatrices(out + i * 16,
+                _mm256_castps256_ps128(m00), _mm256_castps256_ps128(m01), _mm256_castps256_ps128(m02),
+                _mm256_castps256_ps128(m10), _mm256_castps256_ps128(m11), _mm256_castps256_ps128(m12),
+                _mm256_castps256_ps128(m20), _mm256_castps256_ps128(m21), _mm256_castps256_ps128(m22),
+                _mm256_castps256_ps128(tx), _mm256_castps256_ps128(ty), _mm256_castps256_ps128(tz));
+            storeMatrices(out + (i + 4) * 16,
+                _mm256_extractf128_ps(m00, 1), _mm256_extractf128_ps(m01, 1), _mm256_extractf128_ps(m02, 1),
+                _mm256_extractf128_ps(m10, 1), _mm256_extractf128_ps(m11, 1), _mm256_extractf128_ps(m12, 1),
+                _mm256_extractf128_ps(m20, 1), _mm256_extractf128_ps(m21, 1), _mm256_extractf128_ps(m22, 1),
+                _mm256_extractf128_ps(tx, 1), _mm256_extractf128_ps(ty, 1), _mm256_extractf128_ps(tz, 1));
+        }
+#elif defined(JADE_TRANSFORM_SSE)
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 two = _mm_set1_ps(2.f);
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128 x = _mm_loadu_ps(t_batch.rotationX.data() + i);
+            const __m128 y = _mm_loadu_ps(t_batch.rotationY.data() + i);
+            const __m128 z = _mm_loadu_ps(t_batch.rotationZ.data() + i);
+            const __m128 w = _mm_loadu_ps(t_batch.rotationW.data() + i);
+            const __m128 sx = _mm_loadu_ps(t_batch.scaleX.data() + i);
+            const __m128 sy = _mm_loadu_ps(t_batch.scaleY.data() + i);
+            const __m128 sz = _mm_loadu_ps(t_batch.scaleZ.data() + i);
+
+            const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+            storeMatrices(out + i * 16,
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+                _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+                _mm_loadu_ps(t_batch.positionX.data() + i),
+                _mm_loadu_ps(t_batch.positionY.data() + i),
+                _mm_loadu_ps(t_batch.positionZ.data() + i));
+        }
+#endif
+
+        for (; i < count; i++) {
+            composeMatrix(t_batch, i, out + i * 16);
+        }
+    }
+
+    void propagateMatrices(glm::mat4* t_world, const glm::mat4* t_locals, const int32_t* t_parents, const uint32_t* t_nodes, size_t t_count)
+    {
+        for (size_t i = 0; i < t_count; i++) {
+            const uint32_t node = t_nodes[i];
+            const int32_t parent = t_parents[node];
+            if (parent < 0) {
+                t_world[node] = t_locals[i];
+                continue;
+            }
+
+#if defined(JADE_TRANSFORM_SIMD)
+            // every result column is the parent columns weighted by one column of the local matrix
+            const float* a = &t_world[parent][0][0];
+            const float* b = &t_locals[i][0][0];
+            float* out = &t_world[node][0][0];
+
+            const __m128 a0 = _mm_loadu_ps(a);
+            const __m128 a1 = _mm_loadu_ps(a + 4);
+            const __m128 a2 = _mm_loadu_ps(a + 8);
+            const __m128 a3 = _mm_loadu_ps(a + 12);
+            for (int column = 0; column < 4; column++) {
+                const float* bc = b + column * 4;
+                __m128 result = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+                result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+                result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+                result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+                _mm_storeu_ps(out + column * 4, result);
+            }
+#else
+            t_world[node] = t_world[parent] * t_locals[i];
+#endif
+        }
+    }
+}
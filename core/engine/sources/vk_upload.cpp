@@ -0,0 +1,463 @@
+#include "vk_upload.hpp"
+#include "vk_engine.hpp"
+#include "vk_initializers.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+void UploadQueue::init(VulkanEngine* t_engine, VkQueue t_queue, uint32_t t_queueFamily, uint32_t t_graphicsFamily, VkDeviceSize t_stagingSize)
+{
+	m_engine = t_engine;
+	m_queue = t_queue;
+	m_queueFamily = t_queueFamily;
+	m_graphicsFamily = t_graphicsFamily;
+
+	VkCommandPoolCreateInfo poolInfo = vkInit::command_pool_create_info(m_queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VK_CHECK(vkCreateCommandPool(m_engine->device, &poolInfo, nullptr, &m_pool));
+
+	VkSemaphoreTypeCreateInfo timelineInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+	VkSemaphoreCreateInfo semaphoreInfo = vkInit::semaphore_create_info();
+	semaphoreInfo.pNext = &timelineInfo;
+	VK_CHECK(vkCreateSemaphore(m_engine->device, &semaphoreInfo, nullptr, &m_semaphore));
+
+	m_ringSize = t_stagingSize;
+	m_ring = m_engine->createBuffer(m_ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+	// a quarter leaves room for the batches in flight while a large payload streams through
+	m_maxChunk = m_ringSize / 4;
+
+	// image copies on a dedicated transfer family have to respect its granularity
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_engine->chosenGPU, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_engine->chosenGPU, &familyCount, families.data());
+	m_imageGranularity = m_queueFamily < familyCount ? families[m_queueFamily].minImageTransferGranularity : VkExtent3D{ 1, 1, 1 };
+}
+
+void UploadQueue::destroy()
+{
+	flush();
+	wait({ m_lastSubmitted });
+	collect();
+
+	m_engine->destroyBuffer(m_ring);
+	vkDestroySemaphore(m_engine->device, m_semaphore, nullptr);
+	vkDestroyCommandPool(m_engine->device, m_pool, nullptr);
+	m_freeCommandBuffers.clear();
+}
+
+UploadTicket UploadQueue::uploadBuffer(VkBuffer t_dst, VkDeviceSize t_dstOffset, const void* t_data, size_t t_size)
+{
+	if (t_size == 0) {
+		return { m_open.value != 0 ? m_open.value : m_lastSubmitted };
+	}
+
+	const char* source = (const char*)t_data;
+	for (VkDeviceSize done = 0; done < t_size;) {
+		const VkDeviceSize chunk = std::min<VkDeviceSize>(t_size - done, m_maxChunk);
+		const VkDeviceSize stagingOffset = stage(source + done, chunk);
+
+		BufferCopy copy{};
+		copy.dst = t_dst;
+		copy.region.srcOffset = stagingOffset;
+		copy.region.dstOffset = t_dstOffset + done;
+		copy.region.size = chunk;
+		openBatch().bufferCopies.push_back(copy);
+
+		done += chunk;
+	}
+	Batch& batch = openBatch();
+
+	// made visible to the reads on the graphics queue by recordAcquires(). when the families differ this is the
+	// acquire half of an ownership transfer, the release is derived from it by flush()
+	VkBufferMemoryBarrier2 acquire{ .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+	acquire.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	acquire.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	acquire.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+	acquire.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT;
+	acquire.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	acquire.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	if (m_queueFamily != m_graphicsFamily) {
+		// the source scope of an acquire is ignored, the release covers the copy
+		acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.srcQueueFamilyIndex = m_queueFamily;
+		acquire.dstQueueFamilyIndex = m_graphicsFamily;
+	}
+	acquire.buffer = t_dst;
+	acquire.offset = t_dstOffset;
+	acquire.size = t_size;
+	batch.bufferAcquires.push_back(acquire);
+
+	return { batch.value };
+}
+
+UploadTicket UploadQueue::uploadImage(const AllocatedImage& t_image, const void* t_data, size_t t_size)
+{
+	VkImageMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = t_image.image;
+	barrier.subresourceRange = vkInit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+	openBatch().imageTransitions.push_back(barrier);
+
+	const VkExtent3D extent = t_image.imageExtent;
+	auto makeCopy = [&](VkBuffer t_src, VkDeviceSize t_bufferOffset, uint32_t t_y, uint32_t t_z, VkExtent3D t_extent) {
+		ImageCopy copy{};
+		copy.src = t_src;
+		copy.dst = t_image.image;
+		copy.region.bufferOffset = t_bufferOffset;
+		copy.region.bufferRowLength = 0;
+		copy.region.bufferImageHeight = 0;
+		copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.region.imageSubresource.mipLevel = 0;
+		copy.region.imageSubresource.baseArrayLayer = 0;
+		copy.region.imageSubresource.layerCount = 1;
+		copy.region.imageOffset = { 0, static_cast<int32_t>(t_y), static_cast<int32_t>(t_z) };
+		copy.region.imageExtent = t_extent;
+		return copy;
+	};
+
+	// a granularity of (0, 0, 0) only allows whole mips, bands of a volume are not split across slices either
+	const VkExtent3D granularity = m_imageGranularity;
+	const bool wholeImage = granularity.width == 0 || granularity.height == 0 || granularity.depth == 0 ||
+		(extent.depth > 1 && granularity.depth > 1);
+	if (wholeImage) {
+		if (t_size <= m_ringSize) {
+			openBatch().imageCopies.push_back(makeCopy(m_ring.buffer, stage(t_data, t_size), 0, 0, extent));
+		}
+		else {
+			// larger than the whole ring, staged in a buffer of its own that is released with the batch
+			AllocatedBuffer staging = m_engine->createBuffer(t_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+			std::memcpy(staging.info.pMappedData, t_data, t_size);
+			vmaFlushAllocation(m_engine->allocator, staging.allocation, 0, t_size);
+			Batch& batch = openBatch();
+			batch.dedicatedStaging.push_back(staging);
+			batch.imageCopies.push_back(makeCopy(staging.buffer, 0, 0, 0, extent));
+		}
+	}
+	else {
+		// large images are copied a band of rows at a time, a band may land in a later batch than the
+		// transition above, which is fine as both are on the same queue. band heights are multiples of the
+		// granularity, the last band ends at the image edge which is always allowed
+		const VkDeviceSize sliceRows = static_cast<VkDeviceSize>(extent.height) * extent.depth;
+		const VkDeviceSize rowSize = t_size / std::max<VkDeviceSize>(sliceRows, 1);
+		const VkDeviceSize fittingRows = std::max<VkDeviceSize>(m_maxChunk / std::max<VkDeviceSize>(rowSize, 1), 1);
+		const uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<VkDeviceSize>(fittingRows / granularity.height, 1) * granularity.height);
+
+		const char* source = (const char*)t_data;
+		for (uint32_t z = 0; z < extent.depth; z++) {
+			for (uint32_t y = 0; y < extent.height; y += rowsPerChunk) {
+				const uint32_t rows = std::min(rowsPerChunk, extent.height - y);
+				const VkDeviceSize sourceOffset = (static_cast<VkDeviceSize>(z) * extent.height + y) * rowSize;
+				const VkDeviceSize stagingOffset = stage(source + sourceOffset, rows * rowSize);
+				openBatch().imageCopies.push_back(makeCopy(m_ring.buffer, stagingOffset, y, z, { extent.width, rows, 1 }));
+			}
+		}
+	}
+	Batch& batch = openBatch();
+
+	// the layout change to shader read only happens here, as part of the release when the families differ
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	// the timeline semaphore wait of the graphics submit makes the copy visible
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	VkImageMemoryBarrier2 acquire = barrier;
+	acquire.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	acquire.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	if (m_queueFamily != m_graphicsFamily) {
+		barrier.srcQueueFamilyIndex = m_queueFamily;
+		barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+		acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.srcQueueFamilyIndex = m_queueFamily;
+		acquire.dstQueueFamilyIndex = m_graphicsFamily;
+	}
+	else {
+		// same family, the layout is already changed on the transfer queue and only the visibility is left
+		acquire.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	batch.imageAcquires.push_back(acquire);
+	batch.imageReleases.push_back(barrier);
+
+	return { batch.value };
+}
+
+UploadTicket UploadQueue::flush()
+{
+	if (m_open.value == 0) {
+		return { m_lastSubmitted };
+	}
+
+	collect();
+	if (m_freeCommandBuffers.empty()) {
+		VkCommandBufferAllocateInfo allocInfo = vkInit::command_buffer_allocate_info(m_pool, 1);
+		VkCommandBuffer cmd;
+		VK_CHECK(vkAllocateCommandBuffers(m_engine->device, &allocInfo, &cmd));
+		m_freeCommandBuffers.push_back(cmd);
+	}
+	m_open.cmd = m_freeCommandBuffers.back();
+	m_freeCommandBuffers.pop_back();
+
+	VK_CHECK(vkResetCommandBuffer(m_open.cmd, 0));
+	VkCommandBufferBeginInfo beginInfo = vkInit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(m_open.cmd, &beginInfo));
+	record(m_open);
+	VK_CHECK(vkEndCommandBuffer(m_open.cmd));
+
+	VkCommandBufferSubmitInfo cmdInfo = vkInit::command_buffer_submit_info(m_open.cmd);
+	VkSemaphoreSubmitInfo signalInfo = vkInit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_semaphore);
+	signalInfo.value = m_open.value;
+	VkSubmitInfo2 submit = vkInit::submit_info(&cmdInfo, &signalInfo, nullptr);
+	VK_CHECK(vkQueueSubmit2(m_queue, 1, &submit, VK_NULL_HANDLE));
+
+	m_lastSubmitted = m_open.value;
+	m_pendingWaitValue = m_open.value;
+	m_pendingBufferAcquires.insert(m_pendingBufferAcquires.end(), m_open.bufferAcquires.begin(), m_open.bufferAcquires.end());
+	m_pendingImageAcquires.insert(m_pendingImageAcquires.end(), m_open.imageAcquires.begin(), m_open.imageAcquires.end());
+	// only the command buffer and the ring range are needed until the batch completes
+	Batch submitted{};
+	submitted.cmd = m_open.cmd;
+	submitted.value = m_open.value;
+	submitted.ringBytes = m_open.ringBytes;
+	submitted.ringEnd = m_open.ringEnd;
+	submitted.dedicatedStaging = std::move(m_open.dedicatedStaging);
+	m_inFlight.push_back(submitted);
+
+	// cleared instead of reset so the vectors keep their capacity for the next file
+	m_open.cmd = VK_NULL_HANDLE;
+	m_open.value = 0;
+	m_open.ringBytes = 0;
+	m_open.ringEnd = 0;
+	m_open.imageTransitions.clear();
+	m_open.bufferCopies.clear();
+	m_open.imageCopies.clear();
+	m_open.imageReleases.clear();
+	m_open.bufferAcquires.clear();
+	m_open.imageAcquires.clear();
+	m_open.dedicatedStaging.clear();
+
+	return { m_lastSubmitted };
+}
+
+bool UploadQueue::isComplete(UploadTicket t_ticket) const
+{
+	uint64_t value = 0;
+	VK_CHECK(vkGetSemaphoreCounterValue(m_engine->device, m_semaphore, &value));
+	return value >= t_ticket.value;
+}
+
+void UploadQueue::wait(UploadTicket t_ticket) const
+{
+	if (t_ticket.value == 0) {
+		return;
+	}
+	VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_semaphore;
+	waitInfo.pValues = &t_ticket.value;
+	VK_CHECK(vkWaitSemaphores(m_engine->device, &waitInfo, UINT64_MAX));
+}
+
+uint64_t UploadQueue::recordAcquires(VkCommandBuffer t_cmd)
+{
+	collect();
+
+	if (!m_pendingBufferAcquires.empty() || !m_pendingImageAcquires.empty()) {
+		VkDependencyInfo dependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(m_pendingBufferAcquires.size());
+		dependency.pBufferMemoryBarriers = m_pendingBufferAcquires.data();
+		dependency.imageMemoryBarrierCount = static_cast<uint32_t>(m_pendingImageAcquires.size());
+		dependency.pImageMemoryBarriers = m_pendingImageAcquires.data();
+		vkCmdPipelineBarrier2(t_cmd, &dependency);
+
+		m_pendingBufferAcquires.clear();
+		m_pendingImageAcquires.clear();
+	}
+
+	// the submit recording the acquires and first reads of a batch waits on it even when the cpu already
+	// saw it finish, the semaphore wait is what orders them after the copies and the releases.
+	// later submits come after this one on the graphics queue
+	const uint64_t waitValue = m_pendingWaitValue;
+	m_pendingWaitValue = 0;
+	return waitValue;
+}
+
+UploadQueue::Batch& UploadQueue::openBatch()
+{
+	if (m_open.value == 0) {
+		m_open.value = m_nextValue++;
+	}
+	return m_open;
+}
+
+void UploadQueue::record(Batch& t_batch)
+{
+	VkCommandBuffer cmd = t_batch.cmd;
+
+	if (!t_batch.imageTransitions.empty()) {
+		VkDependencyInfo dependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dependency.imageMemoryBarrierCount = static_cast<uint32_t>(t_batch.imageTransitions.size());
+		dependency.pImageMemoryBarriers = t_batch.imageTransitions.data();
+		vkCmdPipelineBarrier2(cmd, &dependency);
+	}
+
+	// a file fills a handful of arena blocks, every block gets one copy command with all of its regions
+	std::stable_sort(t_batch.bufferCopies.begin(), t_batch.bufferCopies.end(), [](const BufferCopy& a, const BufferCopy& b) {
+		return a.dst < b.dst;
+	});
+	std::vector<VkBufferCopy> bufferRegions;
+	for (size_t i = 0; i < t_batch.bufferCopies.size();) {
+		const VkBuffer dst = t_batch.bufferCopies[i].dst;
+		bufferRegions.clear();
+		for (; i < t_batch.bufferCopies.size() && t_batch.bufferCopies[i].dst == dst; i++) {
+			bufferRegions.push_back(t_batch.bufferCopies[i].region);
+		}
+		vkCmdCopyBuffer(cmd, m_ring.buffer, dst, static_cast<uint32_t>(bufferRegions.size()), bufferRegions.data());
+	}
+
+	// the bands of one image are consecutive already
+	std::vector<VkBufferImageCopy> imageRegions;
+	for (size_t i = 0; i < t_batch.imageCopies.size();) {
+		const VkBuffer src = t_batch.imageCopies[i].src;
+		const VkImage dst = t_batch.imageCopies[i].dst;
+		imageRegions.clear();
+		for (; i < t_batch.imageCopies.size() && t_batch.imageCopies[i].dst == dst && t_batch.imageCopies[i].src == src; i++) {
+			imageRegions.push_back(t_batch.imageCopies[i].region);
+		}
+		vkCmdCopyBufferToImage(cmd, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(imageRegions.size()), imageRegions.data());
+	}
+
+	// meshes of a file are mostly allocated back to back, merge their ranges so there is one ownership
+	// transfer per contiguous run instead of one per mesh
+	std::vector<VkBufferMemoryBarrier2>& acquires = t_batch.bufferAcquires;
+	std::sort(acquires.begin(), acquires.end(), [](const VkBufferMemoryBarrier2& a, const VkBufferMemoryBarrier2& b) {
+		return a.buffer != b.buffer ? a.buffer < b.buffer : a.offset < b.offset;
+	});
+	size_t merged = 0;
+	for (size_t i = 0; i < acquires.size(); i++) {
+		VkBufferMemoryBarrier2& last = acquires[merged];
+		if (i != 0 && last.buffer == acquires[i].buffer && acquires[i].offset <= last.offset + last.size) {
+			last.size = std::max(last.offset + last.size, acquires[i].offset + acquires[i].size) - last.offset;
+		}
+		else {
+			acquires[i != 0 ? ++merged : 0] = acquires[i];
+		}
+	}
+	acquires.resize(acquires.empty() ? 0 : merged + 1);
+
+	std::vector<VkBufferMemoryBarrier2> bufferReleases;
+	if (m_queueFamily != m_graphicsFamily) {
+		bufferReleases.assign(acquires.begin(), acquires.end());
+	}
+	for (VkBufferMemoryBarrier2& release : bufferReleases) {
+		release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		release.dstAccessMask = VK_ACCESS_2_NONE;
+	}
+
+	if (!bufferReleases.empty() || !t_batch.imageReleases.empty()) {
+		VkDependencyInfo dependency{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferReleases.size());
+		dependency.pBufferMemoryBarriers = bufferReleases.data();
+		dependency.imageMemoryBarrierCount = static_cast<uint32_t>(t_batch.imageReleases.size());
+		dependency.pImageMemoryBarriers = t_batch.imageReleases.data();
+		vkCmdPipelineBarrier2(cmd, &dependency);
+	}
+}
+
+VkDeviceSize UploadQueue::stage(const void* t_data, VkDeviceSize t_size)
+{
+	std::optional<VkDeviceSize> offset = allocateRing(t_size);
+	while (!offset.has_value()) {
+		// the open batch holds ring space as well, it has to be submitted before it can be reclaimed
+		if (m_open.ringBytes != 0) {
+			flush();
+		}
+		else {
+			wait({ m_inFlight.front().value });
+		}
+		collect();
+		offset = allocateRing(t_size);
+	}
+
+	std::memcpy((char*)m_ring.info.pMappedData + offset.value(), t_data, t_size);
+	vmaFlushAllocation(m_engine->allocator, m_ring.allocation, offset.value(), t_size);
+	return offset.value();
+}
+
+std::optional<VkDeviceSize> UploadQueue::allocateRing(VkDeviceSize t_size)
+{
+	if (m_ringUsed == 0) {
+		m_ringHead = 0;
+		m_ringTail = 0;
+	}
+
+	// copy offsets stay aligned for every texel size
+	constexpr VkDeviceSize alignment = 16;
+	const VkDeviceSize alignedHead = (m_ringHead + alignment - 1) & ~(alignment - 1);
+
+	VkDeviceSize offset = 0;
+	VkDeviceSize consumed = 0;
+	if (m_ringUsed == m_ringSize) {
+		return std::nullopt;
+	}
+	else if (m_ringHead >= m_ringTail) {
+		// free space is [head, size) and [0, tail)
+		if (alignedHead + t_size <= m_ringSize) {
+			offset = alignedHead;
+			consumed = alignedHead - m_ringHead + t_size;
+		}
+		else if (t_size <= m_ringTail) {
+			// wrap around, the end of the ring is skipped
+			offset = 0;
+			consumed = m_ringSize - m_ringHead + t_size;
+		}
+		else {
+			return std::nullopt;
+		}
+	}
+	else {
+		// free space is [head, tail)
+		if (alignedHead + t_size > m_ringTail) {
+			return std::nullopt;
+		}
+		offset = alignedHead;
+		consumed = alignedHead - m_ringHead + t_size;
+	}
+
+	m_ringHead = offset + t_size;
+	m_ringUsed += consumed;
+	m_open.ringBytes += consumed;
+	m_open.ringEnd = m_ringHead;
+	return offset;
+}
+
+void UploadQueue::collect()
+{
+	while (!m_inFlight.empty() && isComplete({ m_inFlight.front().value })) {
+		Batch& batch = m_inFlight.front();
+		if (batch.ringBytes != 0) {
+			m_ringTail = batch.ringEnd;
+			m_ringUsed -= batch.ringBytes;
+		}
+		for (AllocatedBuffer& staging : batch.dedicatedStaging) {
+			m_engine->destroyBuffer(staging);
+		}
+		m_freeCommandBuffers.push_back(batch.cmd);
+		m_inFlight.pop_front();
+	}
+}
@@ -0,0 +1,260 @@
+#include "vk_vertex_assembly.hpp"
+#include "vk_threads.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define JADE_VERTEX_SSE
+#endif
+
+namespace {
+
+    // below this many elements waking the workers costs more than it saves
+    constexpr size_t kParallelThreshold = 64 * 1024;
+    constexpr size_t kChunkSize = 16 * 1024;
+
+    // padded to 4 floats so the vector loads of a missing stream stay in bounds
+    alignas(16) const float kDefaultNormal[4] = { 1.f, 0.f, 0.f, 0.f };
+    alignas(16) const float kDefaultUv[4] = { 0.f, 0.f, 0.f, 0.f };
+    alignas(16) const float kDefaultColor[4] = { 1.f, 1.f, 1.f, 1.f };
+
+    // a missing stream is read with stride 0 from its default, the loop has no branches per attribute
+    struct StridedStreams {
+        const float* positions;
+        const float* normals;
+        const float* uvs;
+        const float* colors;
+        size_t normalStride;
+        size_t uvStride;
+        size_t colorStride;
+    };
+
+    void interleaveScalar(const StridedStreams& t_streams, Vertex* t_out, size_t t_begin, size_t t_end, bool t_colorsFromNormals)
+    {
+        for (size_t i = t_begin; i < t_end; i++) {
+            const float* position = t_streams.positions + i * 3;
+            const float* normal = t_streams.normals + i * t_streams.normalStride;
+            const float* uv = t_streams.uvs + i * t_streams.uvStride;
+            const float* color = t_streams.colors + i * t_streams.colorStride;
+
+            Vertex& vertex = t_out[i];
+            vertex.position = glm::vec3(position[0], position[1], position[2]);
+            vertex.uvX = uv[0];
+            vertex.normal = glm::vec3(normal[0], normal[1], normal[2]);
+            vertex.uvY = uv[1];
+            vertex.color = t_colorsFromNormals ? glm::vec4(vertex.normal, 1.f) : glm::vec4(color[0], color[1], color[2], color[3]);
+        }
+    }
+
+    void interleaveRange(const StridedStreams& t_streams, Vertex* t_out, size_t t_begin, size_t t_end, size_t t_count, bool t_colorsFromNormals)
+    {
+#if defined(JADE_VERTEX_SSE)
+        static_assert(sizeof(Vertex) == 48, "the rows below assume position|uvX, normal|uvY, color");
+
+        // a 3 component stream is read 4 floats at a time, the last vertex would read past its end
+        const size_t simdEnd = std::min(t_end, t_count - 1);
+        const __m128 one = _mm_set1_ps(1.f);
+        size_t i = t_begin;
+        for (; i < simdEnd; i++) {
+            const __m128 position = _mm_loadu_ps(t_streams.positions + i * 3);
+            const __m128 normal = _mm_loadu_ps(t_streams.normals + i * t_streams.normalStride);
+            // [u, v, 0, 0]
+            const __m128 uv = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(t_streams.uvs + i * t_streams.uvStride)));
+
+            // [x, y, z, u] and [nx, ny, nz, v]
+            const __m128 zu = _mm_shuffle_ps(position, uv, _MM_SHUFFLE(0, 0, 2, 2));
+            const __m128 row0 = _mm_shuffle_ps(position, zu, _MM_SHUFFLE(2, 0, 1, 0));
+            const __m128 zv = _mm_shuffle_ps(normal, uv, _MM_SHUFFLE(1, 1, 2, 2));
+            const __m128 row1 = _mm_shuffle_ps(normal, zv, _MM_SHUFFLE(2, 0, 1, 0));
+
+            __m128 row2;
+            if (t_colorsFromNormals) {
+                const __m128 z1 = _mm_shuffle_ps(normal, one, _MM_SHUFFLE(0, 0, 2, 2));
+                row2 = _mm_shuffle_ps(normal, z1, _MM_SHUFFLE(2, 0, 1, 0));
+            }
+            else {
+                row2 = _mm_loadu_ps(t_streams.colors + i * t_streams.colorStride);
+            }
+
+            float* out = reinterpret_cast<float*>(t_out + i);
+            _mm_storeu_ps(out, row0);
+            _mm_storeu_ps(out + 4, row1);
+            _mm_storeu_ps(out + 8, row2);
+        }
+        interleaveScalar(t_streams, t_out, i, t_end, t_colorsFromNormals);
+#else
+        (void)t_count;
+        interleaveScalar(t_streams, t_out, t_begin, t_end, t_colorsFromNormals);
+#endif
+    }
+
+    void offsetRange(uint32_t* t_indices, size_t t_begin, size_t t_end, uint32_t t_offset)
+    {
+        size_t i = t_begin;
+#if defined(JADE_VERTEX_SSE)
+        const __m128i offset = _mm_set1_epi32(static_cast<int>(t_offset));
+        for (; i + 4 <= t_end; i += 4) {
+            __m128i* indices = reinterpret_cast<__m128i*>(t_indices + i);
+            _mm_storeu_si128(indices, _mm_add_epi32(_mm_loadu_si128(indices), offset));
+        }
+#endif
+        for (; i < t_end; i++) {
+            t_indices[i] += t_offset;
+        }
+    }
+
+    // non finite values end up at the low end of the range instead of being undefined casts
+    uint16_t quantizeUnorm16(float t_value, float t_offset, float t_scale)
+    {
+        const float normalized = t_scale > 0.f ? (t_value - t_offset) / t_scale : 0.f;
+        if (!(normalized > 0.f)) {
+            return 0;
+        }
+        return normalized >= 1.f ? uint16_t(65535) : static_cast<uint16_t>(normalized * 65535.f + 0.5f);
+    }
+
+    uint8_t quantizeUnorm8(float t_value)
+    {
+        if (!(t_value > 0.f)) {
+            return 0;
+        }
+        return t_value >= 1.f ? uint8_t(255) : static_cast<uint8_t>(t_value * 255.f + 0.5f);
+    }
+
+    int8_t quantizeSnorm8(float t_value)
+    {
+        if (!(t_value > -1.f)) {
+            return -127;
+        }
+        return t_value >= 1.f ? int8_t(127) : static_cast<int8_t>(std::lround(t_value * 127.f));
+    }
+
+    // octahedral mapping of a normal onto [-1, 1]^2, the lower hemisphere is folded over the diagonals
+    void encodeOctahedral(const glm::vec3& t_normal, float& t_x, float& t_y)
+    {
+        const float length = std::abs(t_normal.x) + std::abs(t_normal.y) + std::abs(t_normal.z);
+        if (!(length > 0.f)) {
+            t_x = 0.f;
+            t_y = 0.f;
+            return;
+        }
+        const float x = t_normal.x / length;
+        const float y = t_normal.y / length;
+        if (t_normal.z >= 0.f) {
+            t_x = x;
+            t_y = y;
+            return;
+        }
+        t_x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+        t_y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+    }
+
+    void packVertex(const Vertex& t_vertex, const GPUVertexHeader& t_header, PackedVertex& t_out)
+    {
+        for (int c = 0; c < 3; c++) {
+            t_out.position[c] = quantizeUnorm16(t_vertex.position[c], t_header.positionOffset[c], t_header.positionScale[c]);
+        }
+        float octX, octY;
+        encodeOctahedral(t_vertex.normal, octX, octY);
+        t_out.normal[0] = quantizeSnorm8(octX);
+        t_out.normal[1] = quantizeSnorm8(octY);
+        t_out.uv[0] = quantizeUnorm16(t_vertex.uvX, t_header.uvOffsetScale.x, t_header.uvOffsetScale.z);
+        t_out.uv[1] = quantizeUnorm16(t_vertex.uvY, t_header.uvOffsetScale.y, t_header.uvOffsetScale.w);
+        for (int c = 0; c < 4; c++) {
+            t_out.color[c] = quantizeUnorm8(t_vertex.color[c]);
+        }
+    }
+
+    // runs t_job over [0, t_count) in chunks on the workers, or inline for small counts
+    template<typename Job>
+    void forEachChunk(size_t t_count, ThreadPool* t_workers, const Job& t_job)
+    {
+        if (t_workers == nullptr || t_count < kParallelThreshold) {
+            t_job(size_t(0), t_count);
+            return;
+        }
+        const uint32_t chunkCount = static_cast<uint32_t>((t_count + kChunkSize - 1) / kChunkSize);
+        t_workers->parallelFor(chunkCount, [&](uint32_t t_chunk) {
+            const size_t begin = t_chunk * kChunkSize;
+            t_job(begin, std::min(begin + kChunkSize, t_count));
+        });
+    }
+}
+
+void vkVertex::interleave(const VertexStreams& t_streams, Vertex* t_out, bool t_colorsFromNormals, ThreadPool* t_workers)
+{
+    if (t_streams.count == 0) {
+        return;
+    }
+
+    StridedStreams streams{};
+    streams.positions = reinterpret_cast<const float*>(t_streams.positions);
+    streams.normals = t_streams.normals ? reinterpret_cast<const float*>(t_streams.normals) : kDefaultNormal;
+    streams.normalStride = t_streams.normals ? 3 : 0;
+    streams.uvs = t_streams.uvs ? reinterpret_cast<const float*>(t_streams.uvs) : kDefaultUv;
+    streams.uvStride = t_streams.uvs ? 2 : 0;
+    streams.colors = t_streams.colors ? reinterpret_cast<const float*>(t_streams.colors) : kDefaultColor;
+    streams.colorStride = t_streams.colors ? 4 : 0;
+
+    forEachChunk(t_streams.count, t_workers, [&](size_t t_begin, size_t t_end) {
+        interleaveRange(streams, t_out, t_begin, t_end, t_streams.count, t_colorsFromNormals);
+    });
+}
+
+void vkVertex::offsetIndices(uint32_t* t_indices, size_t t_count, uint32_t t_offset, ThreadPool* t_workers)
+{
+    if (t_offset == 0) {
+        return;
+    }
+    forEachChunk(t_count, t_workers, [&](size_t t_begin, size_t t_end) {
+        offsetRange(t_indices, t_begin, t_end, t_offset);
+    });
+}
+
+void vkVertex::pack(std::span<const Vertex> t_vertices, PackedVertex* t_out, ThreadPool* t_workers)
+{
+    // ranges of the mesh, nan is skipped by the comparisons
+    constexpr float Largest = std::numeric_limits<float>::max();
+    float minPosition[3] = { Largest, Largest, Largest };
+    float maxPosition[3] = { -Largest, -Largest, -Largest };
+    float minUv[2] = { Largest, Largest };
+    float maxUv[2] = { -Largest, -Largest };
+    for (const Vertex& vertex : t_vertices) {
+        const float uv[2] = { vertex.uvX, vertex.uvY };
+        for (int c = 0; c < 3; c++) {
+            minPosition[c] = vertex.position[c] < minPosition[c] ? vertex.position[c] : minPosition[c];
+            maxPosition[c] = vertex.position[c] > maxPosition[c] ? vertex.position[c] : maxPosition[c];
+        }
+        for (int c = 0; c < 2; c++) {
+            minUv[c] = uv[c] < minUv[c] ? uv[c] : minUv[c];
+            maxUv[c] = uv[c] > maxUv[c] ? uv[c] : maxUv[c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        if (minPosition[c] > maxPosition[c]) {
+            minPosition[c] = maxPosition[c] = 0.f;
+        }
+    }
+    for (int c = 0; c < 2; c++) {
+        if (minUv[c] > maxUv[c]) {
+            minUv[c] = maxUv[c] = 0.f;
+        }
+    }
+
+    GPUVertexHeader header{};
+    header.positionOffset = glm::vec4(minPosition[0], minPosition[1], minPosition[2], 0.f);
+    header.positionScale = glm::vec4(maxPosition[0] - minPosition[0], maxPosition[1] - minPosition[1], maxPosition[2] - minPosition[2], 0.f);
+    header.uvOffsetScale = glm::vec4(minUv[0], minUv[1], maxUv[0] - minUv[0], maxUv[1] - minUv[1]);
+    std::memcpy(t_out, &header, sizeof(GPUVertexHeader));
+
+    PackedVertex* out = t_out + VertexHeaderSlots;
+    forEachChunk(t_vertices.size(), t_workers, [&](size_t t_begin, size_t t_end) {
+        for (size_t i = t_begin; i < t_end; i++) {
+            packVertex(t_vertices[i], header, out[i]);
+        }
+    });
+}
@@ -0,0 +1,26 @@
+layout(set = 0, binding = 0) uniform  SceneData{   
+
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+	vec4 ambientColor;
+	vec4 sunlightDirection; //w for sun power
+	vec4 sunlightColor;
+} sceneData;
+
+//matches GPUMaterialData, the shared material table indexed with the material index of the draw
+struct MaterialData {
+	vec4 colorFactors;
+	vec4 metal_rough_factors;
+	uint colorTexture;
+	uint metalRoughTexture;
+	uint pad0;
+	uint pad1;
+};
+
+layout(buffer_reference, std430) readonly buffer MaterialBuffer{ 
+	MaterialData materials[];
+};
+
+//every texture of every material, the material table holds the slots
+layout(set = 1, binding = 0) uniform sampler2D textures[];
@@ -1,23 +1,13 @@
 #version 450
 #ifdef VULKAN
 
+#extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 outUV;
 
-struct Vertex {
-
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-}; 
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
-	Vertex vertices[];
-};
+#include "vertex_structures.glsl"
 
 //push constants block
 layout( push_constant ) uniform constants
@@ -29,13 +19,12 @@ layout( push_constant ) uniform constants
 void main() 
 {	
 	//load vertex data from device adress
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	Vertex v = unpackVertex(PushConstants.vertexBuffer, gl_VertexIndex);
 
 	//output data
 	gl_Position = PushConstants.render_matrix *vec4(v.position, 1.0f);
 	outColor = v.color.xyz;
-	outUV.x = v.uv_x;
-	outUV.y = v.uv_y;
+	outUV = v.uv;
 }
 
 #endif
\ No newline at end of file
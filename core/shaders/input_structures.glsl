@@ -8,12 +8,19 @@ layout(set = 0, binding = 0) uniform  SceneData{
 	vec4 sunlightColor;
 } sceneData;
 
-layout(set = 1, binding = 0) uniform GLTFMaterialData{   
-
+//matches GPUMaterialData, the shared material table indexed with the material index of the draw
+struct MaterialData {
 	vec4 colorFactors;
 	vec4 metal_rough_factors;
-	
-} materialData;
+	uint colorTexture;
+	uint metalRoughTexture;
+	uint pad0;
+	uint pad1;
+};
+
+layout(buffer_reference, std430) readonly buffer MaterialBuffer{ 
+	MaterialData materials[];
+};
 
 layout(set = 1, binding = 1) uniform sampler2D colorTex;
 layout(set = 1, binding = 2) uniform sampler2D metalRoughTex;
\ No newline at end of file
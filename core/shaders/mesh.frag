@@ -1,6 +1,7 @@
 #version 450
 #ifdef VULKAN
 #extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
 #include "input_structures.glsl"
 
 layout (location = 0) in vec3 inNormal;
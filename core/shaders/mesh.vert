@@ -4,44 +4,44 @@
 #extension GL_EXT_buffer_reference : require
 
 #include "input_structures.glsl"
+#include "vertex_structures.glsl"
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
 
-struct Vertex {
-
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	
-	vec4 color;
-
-}; 
+//one entry per draw, matches GPUInstanceData
+struct InstanceData {
+	mat4 render_matrix;
+	VertexBuffer vertexBuffer;
+	uint materialIndex;
+	uint pad;
+};
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
-	Vertex vertices[];
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{ 
+	InstanceData instances[];
 };
 
 //push constants block
 layout( push_constant ) uniform constants
 {
-	mat4 render_matrix;
-	VertexBuffer vertexBuffer;
+	InstanceBuffer instanceBuffer;
+	MaterialBuffer materialBuffer;
 } PushConstants;
 
 void main() 
 {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	//gl_InstanceIndex already includes the firstInstance of the draw
+	InstanceData instance = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+	Vertex v = unpackVertex(instance.vertexBuffer, gl_VertexIndex);
+	mat4 renderMatrix = instance.render_matrix;
 	
 	vec4 position = vec4(v.position, 1.0f);
 
-	gl_Position =  sceneData.viewproj * PushConstants.render_matrix *position;
+	gl_Position =  sceneData.viewproj * renderMatrix *position;
 
-	outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
-	outColor = v.color.xyz * materialData.colorFactors.xyz;	
-	outUV.x = v.uv_x;
-	outUV.y = v.uv_y;
+	outNormal = (renderMatrix * vec4(v.normal, 0.f)).xyz;
+	outColor = v.color.xyz * PushConstants.materialBuffer.materials[instance.materialIndex].colorFactors.xyz;	
+	outUV = v.uv;
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,50 @@
+#version 450
+#ifdef VULKAN
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "bindless_structures.glsl"
+#include "vertex_structures.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outColorTexture;
+
+//one entry per draw, matches GPUInstanceData
+struct InstanceData {
+	mat4 render_matrix;
+	VertexBuffer vertexBuffer;
+	uint materialIndex;
+	uint pad;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{ 
+	InstanceData instances[];
+};
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	InstanceBuffer instanceBuffer;
+	MaterialBuffer materialBuffer;
+} PushConstants;
+
+void main() 
+{
+	//gl_InstanceIndex already includes the firstInstance of the draw
+	InstanceData instance = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+	Vertex v = unpackVertex(instance.vertexBuffer, gl_VertexIndex);
+	mat4 renderMatrix = instance.render_matrix;
+	
+	vec4 position = vec4(v.position, 1.0f);
+
+	gl_Position =  sceneData.viewproj * renderMatrix *position;
+
+	outNormal = (renderMatrix * vec4(v.normal, 0.f)).xyz;
+	MaterialData material = PushConstants.materialBuffer.materials[instance.materialIndex];
+	outColor = v.color.xyz * material.colorFactors.xyz;	
+	outUV = v.uv;
+	outColorTexture = material.colorTexture;
+}
+#endif
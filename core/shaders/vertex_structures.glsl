@@ -0,0 +1,38 @@
+//matches GPUVertexHeader followed by PackedVertex, the vertex address of a mesh points at the header
+//a vertex is 16 bytes: position unorm16 x3 and octahedral normal snorm8 x2, uv unorm16 x2, color rgba8
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+	vec4 positionOffset;
+	vec4 positionScale;
+	vec4 uvOffsetScale;
+	uvec4 vertices[];
+};
+
+struct Vertex {
+	vec3 position;
+	vec3 normal;
+	vec2 uv;
+	vec4 color;
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+Vertex unpackVertex(VertexBuffer buffer, int index)
+{
+	uvec4 data = buffer.vertices[index];
+	vec2 xy = unpackUnorm2x16(data.x);
+	vec4 zNormal = vec4(unpackUnorm2x16(data.y).x, 0.0, unpackSnorm4x8(data.y).zw);
+
+	Vertex v;
+	v.position = buffer.positionOffset.xyz + vec3(xy, zNormal.x) * buffer.positionScale.xyz;
+	v.normal = decodeOctahedral(zNormal.zw);
+	v.uv = buffer.uvOffsetScale.xy + unpackUnorm2x16(data.z) * buffer.uvOffsetScale.zw;
+	v.color = unpackUnorm4x8(data.w);
+	return v;
+}